@@ -4,10 +4,19 @@
 #include "VK.hpp"
 #include "refsol.hpp"
 
+#include <vulkan/utility/vk_format_utils.h> //useful for byte counting
+
+#include <algorithm>
+#include <array>
 #include <utility>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <iterator>
+#include <numeric>
+#include <string>
 
 Helpers::Allocation::Allocation(Allocation &&from) {
 	assert(handle == VK_NULL_HANDLE && offset == 0 && size == 0 && mapped == nullptr);
@@ -40,39 +49,1609 @@ Helpers::Allocation::~Allocation() {
 
 //----------------------------
 
-Helpers::AllocatedBuffer Helpers::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map) {
+Helpers::Allocation Helpers::allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t memory_type_index, MapFlag map, TilingKind tiling) {
+	assert(memory_type_index < memory_properties.memoryTypeCount);
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0); //Vulkan alignments are powers of two
+
+	VkDeviceSize block_size = block_sizes[memory_type_index];
+
+	Allocation allocation;
+
+	uint32_t heap_index = memory_properties.memoryTypes[memory_type_index].heapIndex;
+
+	//big allocations get their own VkDeviceMemory:
+	if (size > block_size / 2) {
+		check_memory_limit(memory_type_index, size);
+		VkMemoryAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = size,
+			.memoryTypeIndex = memory_type_index,
+		};
+		VK( vkAllocateMemory(rtg.device, &alloc_info, nullptr, &allocation.handle) );
+		dedicated_allocations.emplace(allocation.handle, memory_type_index);
+		heap_reserved[heap_index] += size;
+		type_allocated[memory_type_index] += size;
+		allocation.size = size;
+		allocation.offset = 0;
+		if (map == Mapped) {
+			VK( vkMapMemory(rtg.device, allocation.handle, 0, allocation.size, 0, &allocation.mapped) );
+		}
+		return allocation;
+	}
+
+	//find the free range (in any compatible block) that leaves the smallest leftover:
+	MemoryBlock *best_block = nullptr;
+	VkDeviceSize best_offset = 0; //start of the free range
+	VkDeviceSize best_waste = ~VkDeviceSize(0);
+	for (auto &[handle, block] : memory_blocks) {
+		if (block.memory_type_index != memory_type_index || block.tiling != tiling) continue;
+		for (auto const &[offset, range] : block.free_ranges) {
+			VkDeviceSize aligned = (offset + alignment - 1) & ~(alignment - 1);
+			if (aligned + size > offset + range) continue;
+			VkDeviceSize waste = range - size;
+			if (waste < best_waste) {
+				best_block = &block;
+				best_offset = offset;
+				best_waste = waste;
+			}
+		}
+	}
+
+	//no room anywhere? make a new block:
+	if (best_block == nullptr) {
+		MemoryBlock block;
+		block.size = block_size;
+		block.memory_type_index = memory_type_index;
+		block.tiling = tiling;
+		check_memory_limit(memory_type_index, block.size);
+		VkMemoryAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = block.size,
+			.memoryTypeIndex = memory_type_index,
+		};
+		VK( vkAllocateMemory(rtg.device, &alloc_info, nullptr, &block.handle) );
+		heap_reserved[heap_index] += block.size;
+		block.free_ranges.emplace(0, block.size);
+
+		auto ret = memory_blocks.emplace(block.handle, std::move(block));
+		assert(ret.second);
+		best_block = &ret.first->second;
+		best_offset = 0;
+	}
+
+	MemoryBlock &block = *best_block;
+
+	//carve the allocation out of the free range:
+	auto range = block.free_ranges.find(best_offset);
+	assert(range != block.free_ranges.end());
+	VkDeviceSize range_begin = range->first;
+	VkDeviceSize range_end = range->first + range->second;
+	block.free_ranges.erase(range);
+
+	VkDeviceSize begin = (range_begin + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize end = begin + size;
+	assert(end <= range_end);
+
+	//alignment padding at the front and leftover space at the back stay free:
+	if (range_begin < begin) block.free_ranges.emplace(range_begin, begin - range_begin);
+	if (end < range_end) block.free_ranges.emplace(end, range_end - end);
+	block.used += size;
+	type_allocated[memory_type_index] += size;
+
+	if (map == Mapped && block.mapped == nullptr) {
+		VK( vkMapMemory(rtg.device, block.handle, 0, block.size, 0, &block.mapped) );
+	}
+
+	allocation.handle = block.handle;
+	allocation.offset = begin;
+	allocation.size = size;
+	allocation.mapped = (map == Mapped ? block.mapped : nullptr);
+
+	return allocation;
+}
+
+Helpers::Allocation Helpers::allocate(VkMemoryRequirements const &req, VkMemoryPropertyFlags properties, MapFlag map, TilingKind tiling) {
+	return allocate(req.size, req.alignment, find_memory_type(req.memoryTypeBits, properties), map, tiling);
+}
+
+void Helpers::free(Helpers::Allocation &&allocation) {
+	if (allocation.handle == VK_NULL_HANDLE) return;
+
+	auto found = memory_blocks.find(allocation.handle);
+	if (found == memory_blocks.end()) {
+		//not part of a block, so must be a dedicated allocation:
+		auto dedicated = dedicated_allocations.find(allocation.handle);
+		assert(dedicated != dedicated_allocations.end());
+		uint32_t memory_type_index = dedicated->second;
+		dedicated_allocations.erase(dedicated);
+		heap_reserved[memory_properties.memoryTypes[memory_type_index].heapIndex] -= allocation.size;
+		type_allocated[memory_type_index] -= allocation.size;
+
+		if (allocation.mapped != nullptr) {
+			vkUnmapMemory(rtg.device, allocation.handle);
+		}
+		vkFreeMemory(rtg.device, allocation.handle, nullptr);
+	} else {
+		MemoryBlock &block = found->second;
+		assert(allocation.offset + allocation.size <= block.size);
+		assert(block.used >= allocation.size);
+
+		VkDeviceSize begin = allocation.offset;
+		VkDeviceSize end = allocation.offset + allocation.size;
+
+		//merge with the following free range:
+		auto after = block.free_ranges.lower_bound(begin);
+		if (after != block.free_ranges.end() && after->first == end) {
+			end = after->first + after->second;
+			after = block.free_ranges.erase(after);
+		}
+		//merge with the preceding free range:
+		if (after != block.free_ranges.begin()) {
+			auto before = std::prev(after);
+			if (before->first + before->second == begin) {
+				begin = before->first;
+				block.free_ranges.erase(before);
+			}
+		}
+		block.free_ranges.emplace(begin, end - begin);
+		block.used -= allocation.size;
+		type_allocated[block.memory_type_index] -= allocation.size;
+
+		//release empty blocks, but keep one around per (type, tiling) so a create/destroy loop doesn't thrash vkAllocateMemory:
+		if (block.used == 0) {
+			bool has_sibling = false;
+			for (auto const &[handle, other] : memory_blocks) {
+				if (&other != &block && other.memory_type_index == block.memory_type_index && other.tiling == block.tiling) {
+					has_sibling = true;
+					break;
+				}
+			}
+			if (has_sibling) {
+				heap_reserved[memory_properties.memoryTypes[block.memory_type_index].heapIndex] -= block.size;
+				if (block.mapped) vkUnmapMemory(rtg.device, block.handle);
+				vkFreeMemory(rtg.device, block.handle, nullptr);
+				memory_blocks.erase(found);
+			}
+		}
+	}
+
+	allocation.handle = VK_NULL_HANDLE;
+	allocation.offset = 0;
+	allocation.size = 0;
+	allocation.mapped = nullptr;
+}
+
+//helper: fetch per-heap budget and usage (only call if rtg.memory_budget_supported):
+static VkPhysicalDeviceMemoryBudgetPropertiesEXT query_memory_budget(VkPhysicalDevice physical_device) {
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+	};
+	VkPhysicalDeviceMemoryProperties2 properties{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = &budget,
+	};
+	vkGetPhysicalDeviceMemoryProperties2(physical_device, &properties);
+	return budget;
+}
+
+void Helpers::check_memory_limit(uint32_t memory_type_index, VkDeviceSize size) const {
+	uint32_t heap_index = memory_properties.memoryTypes[memory_type_index].heapIndex;
+
+	VkDeviceSize limit = rtg.configuration.memory_limit;
+	if (limit != 0 && heap_reserved[heap_index] + size > limit) {
+		throw std::runtime_error("Allocating " + std::to_string(size) + " bytes would put memory heap " + std::to_string(heap_index) + " at " + std::to_string(heap_reserved[heap_index] + size) + " bytes, over the memory limit of " + std::to_string(limit) + ".");
+	}
+
+	if (rtg.configuration.memory_limit_budget && rtg.memory_budget_supported) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = query_memory_budget(rtg.physical_device);
+		if (budget.heapUsage[heap_index] + size > budget.heapBudget[heap_index]) {
+			throw std::runtime_error("Allocating " + std::to_string(size) + " bytes would put memory heap " + std::to_string(heap_index) + " at " + std::to_string(budget.heapUsage[heap_index] + size) + " bytes, over its budget of " + std::to_string(budget.heapBudget[heap_index]) + ".");
+		}
+	}
+}
+
+Helpers::MemoryStats Helpers::memory_stats() const {
+	MemoryStats stats;
+	stats.type_allocated = type_allocated;
+	stats.heaps.resize(memory_properties.memoryHeapCount);
+
+	for (uint32_t h = 0; h < memory_properties.memoryHeapCount; ++h) {
+		stats.heaps[h].size = memory_properties.memoryHeaps[h].size;
+		stats.heaps[h].reserved = heap_reserved[h];
+	}
+	for (uint32_t t = 0; t < memory_properties.memoryTypeCount; ++t) {
+		stats.heaps[memory_properties.memoryTypes[t].heapIndex].allocated += type_allocated[t];
+	}
+	for (auto const &[handle, memory_type_index] : dedicated_allocations) {
+		stats.heaps[memory_properties.memoryTypes[memory_type_index].heapIndex].dedicated += 1;
+	}
+
+	//fragmentation, from the free ranges in each heap's blocks:
+	std::vector< VkDeviceSize > free_bytes(memory_properties.memoryHeapCount, 0);
+	std::vector< VkDeviceSize > largest_free(memory_properties.memoryHeapCount, 0);
+	for (auto const &[handle, block] : memory_blocks) {
+		uint32_t h = memory_properties.memoryTypes[block.memory_type_index].heapIndex;
+		stats.heaps[h].blocks += 1;
+		for (auto const &[offset, range] : block.free_ranges) {
+			free_bytes[h] += range;
+			largest_free[h] = std::max(largest_free[h], range);
+		}
+	}
+	for (uint32_t h = 0; h < memory_properties.memoryHeapCount; ++h) {
+		if (free_bytes[h] != 0) {
+			stats.heaps[h].fragmentation = 1.0f - float(double(largest_free[h]) / double(free_bytes[h]));
+		}
+	}
+
+	if (rtg.memory_budget_supported) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = query_memory_budget(rtg.physical_device);
+		for (uint32_t h = 0; h < memory_properties.memoryHeapCount; ++h) {
+			stats.heaps[h].budget = budget.heapBudget[h];
+			stats.heaps[h].usage = budget.heapUsage[h];
+		}
+	}
+
+	return stats;
+}
+
+void Helpers::report_memory(std::ostream &out) const {
+	MemoryStats stats = memory_stats();
+
+	auto MiB = [](VkDeviceSize bytes) {
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.1f", double(bytes) / (1024.0 * 1024.0));
+		return std::string(buffer);
+	};
+
+	out << "Memory:";
+	for (uint32_t h = 0; h < stats.heaps.size(); ++h) {
+		MemoryStats::Heap const &heap = stats.heaps[h];
+		if (heap.reserved == 0 && heap.usage == 0) continue; //(nothing interesting to say)
+		out << " [heap " << h << "] " << MiB(heap.allocated) << " of " << MiB(heap.reserved) << " MiB used"
+		    << " (" << heap.blocks << " blocks, " << heap.dedicated << " dedicated, " << int(std::round(heap.fragmentation * 100.0f)) << "% fragmented)";
+		if (heap.budget != 0) {
+			out << ", " << MiB(heap.budget > heap.usage ? heap.budget - heap.usage : 0) << " MiB headroom in " << MiB(heap.budget) << " MiB budget";
+		} else {
+			out << ", heap is " << MiB(heap.size) << " MiB";
+		}
+		out << ";";
+	}
+	out << std::endl;
+}
+
+//----------------------------
+
+Helpers::AllocatedBuffer Helpers::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map, BindlessFlag bindless) {
 	AllocatedBuffer buffer;
-	refsol::Helpers_create_buffer(rtg, size, usage, properties, (map == Mapped), &buffer);
+	VkBufferCreateInfo create_info{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage | (bindless == Bindless ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0),
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VK( vkCreateBuffer(rtg.device, &create_info, nullptr, &buffer.handle) );
+	buffer.size = size;
+
+	//determine memory requirements:
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(rtg.device, buffer.handle, &req);
+
+	//allocate memory:
+	buffer.allocation = allocate(req, properties, map, LinearTiling);
+
+	//bind memory:
+	VK( vkBindBufferMemory(rtg.device, buffer.handle, buffer.allocation.handle, buffer.allocation.offset) );
+
+	if (bindless == Bindless) {
+		buffer.bindless_index = register_buffer(buffer.handle);
+	}
+	return buffer;
+}
+
+Helpers::AllocatedBuffer Helpers::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage, BindlessFlag bindless) {
+	if (memory_usage != Dynamic) usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	AllocatedBuffer buffer;
+	VkBufferCreateInfo create_info{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage | (bindless == Bindless ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0),
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VK( vkCreateBuffer(rtg.device, &create_info, nullptr, &buffer.handle) );
+	buffer.size = size;
+
+	//determine memory requirements:
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(rtg.device, buffer.handle, &req);
+
+	//allocate memory, mapping it whenever that's possible:
+	uint32_t memory_type_index = find_memory_type(req.memoryTypeBits, memory_usage);
+	bool host_visible = (memory_properties.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+	buffer.allocation = allocate(req.size, req.alignment, memory_type_index, (host_visible ? Mapped : Unmapped), LinearTiling);
+
+	//bind memory:
+	VK( vkBindBufferMemory(rtg.device, buffer.handle, buffer.allocation.handle, buffer.allocation.offset) );
+
+	if (bindless == Bindless) {
+		buffer.bindless_index = register_buffer(buffer.handle);
+	}
 	return buffer;
 }
 
 void Helpers::destroy_buffer(AllocatedBuffer &&buffer) {
-	refsol::Helpers_destroy_buffer(rtg, &buffer);
+	if (buffer.bindless_index != -1U) {
+		unregister_buffer(buffer.bindless_index);
+		buffer.bindless_index = -1U;
+	}
+
+	vkDestroyBuffer(rtg.device, buffer.handle, nullptr);
+	buffer.handle = VK_NULL_HANDLE;
+	buffer.size = 0;
+
+	this->free(std::move(buffer.allocation));
 }
 
 
-Helpers::AllocatedImage Helpers::create_image(VkExtent2D const &extent, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map) {
+Helpers::AllocatedImage Helpers::create_image(VkExtent2D const &extent, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map, BindlessFlag bindless, uint32_t mip_levels, uint32_t array_layers) {
+	assert(mip_levels >= 1 && mip_levels <= full_mip_levels(extent));
+	assert(array_layers >= 1);
+
 	AllocatedImage image;
-	refsol::Helpers_create_image(rtg, extent, format, tiling, usage, properties, (map == Mapped), &image);
+	image.extent = extent;
+	image.format = format;
+	image.mip_levels = mip_levels;
+	image.array_layers = array_layers;
+
+	if (bindless == Bindless) usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (mip_levels > 1) usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	VkImageCreateInfo create_info{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = format,
+		.extent{
+			.width = extent.width,
+			.height = extent.height,
+			.depth = 1
+		},
+		.mipLevels = mip_levels,
+		.arrayLayers = array_layers,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = tiling,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	VK( vkCreateImage(rtg.device, &create_info, nullptr, &image.handle) );
+
+	VkMemoryRequirements req;
+	vkGetImageMemoryRequirements(rtg.device, image.handle, &req);
+
+	image.allocation = allocate(req, properties, map, (tiling == VK_IMAGE_TILING_LINEAR ? LinearTiling : OptimalTiling));
+
+	VK( vkBindImageMemory(rtg.device, image.handle, image.allocation.handle, image.allocation.offset) );
+
+	if (bindless == Bindless) {
+		VkImageViewCreateInfo view_info{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = image.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = format,
+			.subresourceRange{
+				.aspectMask = VkImageAspectFlags(vkuFormatHasDepth(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT),
+				.baseMipLevel = 0,
+				.levelCount = mip_levels,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+		};
+		VK( vkCreateImageView(rtg.device, &view_info, nullptr, &image.bindless_view) );
+		image.bindless_index = register_image(image.bindless_view);
+	}
 	return image;
 }
 
 void Helpers::destroy_image(AllocatedImage &&image) {
-	refsol::Helpers_destroy_image(rtg, &image);
+	if (image.bindless_index != -1U) {
+		unregister_image(image.bindless_index);
+		image.bindless_index = -1U;
+	}
+	if (image.bindless_view != VK_NULL_HANDLE) {
+		vkDestroyImageView(rtg.device, image.bindless_view, nullptr);
+		image.bindless_view = VK_NULL_HANDLE;
+	}
+
+	vkDestroyImage(rtg.device, image.handle, nullptr);
+
+	image.handle = VK_NULL_HANDLE;
+	image.extent = VkExtent2D{.width = 0, .height = 0};
+	image.format = VK_FORMAT_UNDEFINED;
+	image.mip_levels = 1;
+	image.array_layers = 1;
+
+	this->free(std::move(image.allocation));
+}
+
+uint32_t Helpers::full_mip_levels(VkExtent2D const &extent) {
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(extent.width, extent.height); size > 1; size /= 2) {
+		levels += 1;
+	}
+	return levels;
+}
+
+size_t Helpers::mip_level_bytes(AllocatedImage const &image, uint32_t level) {
+	assert(level < image.mip_levels);
+	uint32_t width = std::max(1u, image.extent.width >> level);
+	uint32_t height = std::max(1u, image.extent.height >> level);
+
+	//(block-compressed formats store whole blocks, even for levels smaller than a block)
+	VkExtent3D block = vkuFormatTexelBlockExtent(image.format);
+	size_t blocks_wide = (width + block.width - 1) / block.width;
+	size_t blocks_high = (height + block.height - 1) / block.height;
+	return blocks_wide * blocks_high * vkuFormatTexelBlockSize(image.format) * image.array_layers;
+}
+
+//where each of the first 'levels' levels goes in a staging buffer for vkCmdCopyBufferToImage:
+// (bufferOffset must be a multiple of the texel block size, and -- on transfer-only queues -- of 4, so levels are padded apart)
+static std::vector< VkDeviceSize > staged_level_offsets(Helpers::AllocatedImage const &image, uint32_t levels, VkDeviceSize *total_bytes) {
+	VkDeviceSize alignment = std::lcm< VkDeviceSize >(4, vkuFormatTexelBlockSize(image.format));
+	std::vector< VkDeviceSize > offsets;
+	VkDeviceSize offset = 0;
+	for (uint32_t level = 0; level < levels; ++level) {
+		offset = (offset + alignment - 1) / alignment * alignment;
+		offsets.emplace_back(offset);
+		offset += Helpers::mip_level_bytes(image, level);
+	}
+	*total_bytes = offset;
+	return offsets;
+}
+
+//copy tightly packed level data into the layout given by staged_level_offsets:
+static void stage_levels(Helpers::AllocatedImage const &image, std::vector< VkDeviceSize > const &offsets, void const *data, char *staging) {
+	char const *src = reinterpret_cast< char const * >(data);
+	for (uint32_t level = 0; level < offsets.size(); ++level) {
+		size_t bytes = Helpers::mip_level_bytes(image, level);
+		std::memcpy(staging + offsets[level], src, bytes);
+		src += bytes;
+	}
 }
 
 //----------------------------
 
-void Helpers::transfer_to_buffer(void const *data, size_t size, AllocatedBuffer &target) {
-	refsol::Helpers_transfer_to_buffer(rtg, data, size, &target);
+bool Helpers::separate_transfer_family() const {
+	return rtg.transfer_queue_family.value() != rtg.graphics_queue_family.value();
+}
+
+void Helpers::begin_transfer() {
+	VK( vkResetCommandPool(rtg.device, transfer_command_pool, 0) );
+
+	VkCommandBufferBeginInfo begin_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, //will record again every submit
+	};
+	VK( vkBeginCommandBuffer(transfer_command_buffer, &begin_info) );
+
+	if (separate_transfer_family()) {
+		VK( vkResetCommandPool(rtg.device, acquire_command_pool, 0) );
+		VK( vkBeginCommandBuffer(acquire_command_buffer, &begin_info) );
+	}
+}
+
+void Helpers::finish_transfer() {
+	VK( vkEndCommandBuffer(transfer_command_buffer) );
+
+	if (separate_transfer_family()) {
+		VK( vkEndCommandBuffer(acquire_command_buffer) );
+
+		//copy on the transfer queue, then hand off to the graphics queue:
+		VkSubmitInfo transfer_submit{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &transfer_command_buffer,
+			.signalSemaphoreCount = 1,
+			.pSignalSemaphores = &transfer_done,
+		};
+		VK( vkQueueSubmit(rtg.transfer_queue, 1, &transfer_submit, VK_NULL_HANDLE) );
+
+		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkSubmitInfo acquire_submit{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.waitSemaphoreCount = 1,
+			.pWaitSemaphores = &transfer_done,
+			.pWaitDstStageMask = &wait_stage,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &acquire_command_buffer,
+		};
+		VK( vkQueueSubmit(rtg.graphics_queue, 1, &acquire_submit, transfer_fence) );
+	} else {
+		VkSubmitInfo submit_info{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &transfer_command_buffer,
+		};
+		VK( vkQueueSubmit(rtg.transfer_queue, 1, &submit_info, transfer_fence) );
+	}
+
+	//wait for the transfer to finish:
+	VK( vkWaitForFences(rtg.device, 1, &transfer_fence, VK_TRUE, UINT64_MAX) );
+	VK( vkResetFences(rtg.device, 1, &transfer_fence) );
+}
+
+void Helpers::transfer_to_buffer(void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset) {
+	assert(target_offset + size <= target.size);
+	if (size == 0) return;
+
+	//fast path: target is mapped, so just write it:
+	// (mapped memory from Helpers is host-coherent, and the write is visible to any later submit)
+	if (target.allocation.mapped != nullptr) {
+		std::memcpy(reinterpret_cast< char * >(target.allocation.data()) + target_offset, data, size);
+		return;
+	}
+
+	//put data in a host-visible buffer: (one chunk at a time, reusing the buffer)
+	AllocatedBuffer transfer_src = create_buffer(
+		std::min< VkDeviceSize >(size, TransferChunkSize),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		Mapped
+	);
+
+	//with a separate transfer family, the buffer may already belong to the graphics family (e.g., from an earlier upload).
+	// A write covering the whole buffer can just take ownership on the transfer queue, since none of the old contents matter;
+	// but a partial write would leave the rest of the buffer undefined, so those are copied on the graphics queue instead:
+	bool on_graphics = separate_transfer_family() && !(target_offset == 0 && size == target.size);
+	VkCommandBuffer command_buffer = (on_graphics ? acquire_command_buffer : transfer_command_buffer);
+
+	for (size_t done = 0; done < size; done += transfer_src.size) {
+		size_t chunk = std::min< size_t >(size - done, transfer_src.size);
+		std::memcpy(transfer_src.allocation.data(), reinterpret_cast< char const * >(data) + done, chunk);
+
+		begin_transfer();
+
+		VkBufferCopy copy_region{
+			.srcOffset = 0,
+			.dstOffset = target_offset + done,
+			.size = chunk,
+		};
+		vkCmdCopyBuffer(command_buffer, transfer_src.handle, target.handle, 1, &copy_region);
+
+		//the transfer queue keeps the buffer until the last chunk is written; only then is it handed off (or made visible):
+		// (barriers cover everything earlier in submission order, so one at the end covers every chunk)
+		if (done + chunk < size) {
+			finish_transfer();
+			continue;
+		}
+
+		if (separate_transfer_family() && !on_graphics) {
+			//release ownership from the transfer family...
+			VkBufferMemoryBarrier handoff{
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = 0, //ignored for a release
+				.srcQueueFamilyIndex = rtg.transfer_queue_family.value(),
+				.dstQueueFamilyIndex = rtg.graphics_queue_family.value(),
+				.buffer = target.handle,
+				.offset = 0,
+				.size = VK_WHOLE_SIZE,
+			};
+			vkCmdPipelineBarrier(transfer_command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr,
+				1, &handoff,
+				0, nullptr
+			);
+
+			//...and acquire it in the graphics family:
+			handoff.srcAccessMask = 0; //ignored for an acquire
+			handoff.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			vkCmdPipelineBarrier(acquire_command_buffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+				0, nullptr,
+				1, &handoff,
+				0, nullptr
+			);
+		} else {
+			//make the copy visible to whatever uses the buffer later:
+			VkMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			};
+			vkCmdPipelineBarrier(command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+				1, &barrier,
+				0, nullptr,
+				0, nullptr
+			);
+		}
+
+		finish_transfer();
+	}
+
+	//don't need the staging buffer anymore:
+	destroy_buffer(std::move(transfer_src));
+}
+
+uint32_t Helpers::image_levels_given(AllocatedImage const &image, size_t size, char const *caller) {
+	size_t chain_bytes = 0;
+	for (uint32_t level = 0; level < image.mip_levels; ++level) {
+		chain_bytes += mip_level_bytes(image, level);
+	}
+	size_t base_bytes = mip_level_bytes(image, 0);
+	if (size == chain_bytes) {
+		return image.mip_levels;
+	} else if (size == base_bytes) {
+		return 1;
+	} else {
+		throw std::runtime_error(std::string("Helpers::") + caller + ": got " + std::to_string(size) + " bytes, but a " + std::to_string(image.extent.width) + "x" + std::to_string(image.extent.height) + " " + string_VkFormat(image.format)
+			+ " image (" + std::to_string(image.mip_levels) + " levels, " + std::to_string(image.array_layers) + " layers) needs " + std::to_string(base_bytes) + " (base level only) or " + std::to_string(chain_bytes) + " (all levels).");
+	}
 }
 
 void Helpers::transfer_to_image(void const *data, size_t size, AllocatedImage &target) {
-	refsol::Helpers_transfer_to_image(rtg, data, size, &target);
+	assert(target.handle != VK_NULL_HANDLE);
+
+	//check data is the right size (either just the base level or the whole chain):
+	uint32_t levels_given = image_levels_given(target, size, "transfer_to_image");
+	VkDeviceSize staged_bytes = 0;
+	std::vector< VkDeviceSize > level_offsets = staged_level_offsets(target, levels_given, &staged_bytes); //where each level starts in transfer_src
+
+	//put data in a host-visible buffer:
+	AllocatedBuffer transfer_src = create_buffer(
+		staged_bytes,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		Mapped
+	);
+	stage_levels(target, level_offsets, data, reinterpret_cast< char * >(transfer_src.allocation.data()));
+
+	begin_transfer();
+
+	VkImageSubresourceRange whole_image{
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0,
+		.levelCount = target.mip_levels,
+		.baseArrayLayer = 0,
+		.layerCount = target.array_layers,
+	};
+
+	{ //put the image in the right layout to receive the copy:
+		VkImageMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = target.handle,
+			.subresourceRange = whole_image,
+		};
+		vkCmdPipelineBarrier(transfer_command_buffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+	}
+
+	{ //copy the data: (one region per level, all in one copy command)
+		std::vector< VkBufferImageCopy > regions;
+		for (uint32_t level = 0; level < levels_given; ++level) {
+			regions.emplace_back(VkBufferImageCopy{
+				.bufferOffset = level_offsets[level],
+				.bufferRowLength = 0, //tightly packed
+				.bufferImageHeight = 0,
+				.imageSubresource{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = level,
+					.baseArrayLayer = 0,
+					.layerCount = target.array_layers,
+				},
+				.imageOffset{ .x = 0, .y = 0, .z = 0 },
+				.imageExtent{
+					.width = std::max(1u, target.extent.width >> level),
+					.height = std::max(1u, target.extent.height >> level),
+					.depth = 1
+				},
+			});
+		}
+		vkCmdCopyBufferToImage(transfer_command_buffer, transfer_src.handle, target.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(regions.size()), regions.data());
+	}
+
+	//transition to a layout for reading from shaders: (handing off ownership if needed)
+	VkImageMemoryBarrier barrier{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = target.handle,
+		.subresourceRange = whole_image,
+	};
+	if (separate_transfer_family()) {
+		barrier.srcQueueFamilyIndex = rtg.transfer_queue_family.value();
+		barrier.dstQueueFamilyIndex = rtg.graphics_queue_family.value();
+
+		//release (the layout transition happens once, between release and acquire):
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(transfer_command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+
+		//acquire:
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(acquire_command_buffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+	} else {
+		vkCmdPipelineBarrier(transfer_command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+	}
+
+	//fill in any levels that weren't given: (on the graphics queue, since blits need it)
+	if (levels_given < target.mip_levels) {
+		generate_mipmaps(separate_transfer_family() ? acquire_command_buffer : transfer_command_buffer, {&target});
+	}
+
+	finish_transfer();
+
+	//don't need the staging buffer anymore:
+	destroy_buffer(std::move(transfer_src));
+}
+
+void Helpers::UploadBatch::add(void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset) {
+	assert(target_offset + size <= target.size);
+	if (size == 0) return;
+	buffers.emplace_back(BufferUpload{
+		.data = data,
+		.size = size,
+		.target = &target,
+		.target_offset = target_offset,
+	});
+}
+
+void Helpers::UploadBatch::add(void const *data, size_t size, AllocatedImage &target) {
+	assert(target.handle != VK_NULL_HANDLE);
+	image_levels_given(target, size, "UploadBatch::add"); //(throws if size is wrong, so transfer_batch doesn't have to)
+	images.emplace_back(ImageUpload{
+		.data = data,
+		.size = size,
+		.target = &target,
+	});
+}
+
+void Helpers::transfer_batch(UploadBatch &batch) {
+	//mapped buffers are just written, as in transfer_to_buffer; everything else needs staging:
+	std::vector< UploadBatch::BufferUpload > buffers;
+	buffers.reserve(batch.buffers.size());
+	for (UploadBatch::BufferUpload const &upload : batch.buffers) {
+		if (upload.target->allocation.mapped != nullptr) {
+			std::memcpy(reinterpret_cast< char * >(upload.target->allocation.data()) + upload.target_offset, upload.data, upload.size);
+		} else {
+			buffers.emplace_back(upload);
+		}
+	}
+	std::vector< UploadBatch::ImageUpload > const &images = batch.images;
+
+	if (buffers.empty() && images.empty()) {
+		batch = UploadBatch();
+		return;
+	}
+
+	//regions start 16-byte aligned, and image regions also on a multiple of their texel block size:
+	auto align_to = [](VkDeviceSize offset, VkDeviceSize alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	};
+	auto image_alignment = [](AllocatedImage const &image) {
+		return std::lcm< VkDeviceSize >(16, vkuFormatTexelBlockSize(image.format));
+	};
+
+	//size the staging buffer: everything, if it fits in a chunk; otherwise a chunk, but at least the largest image (images aren't split):
+	VkDeviceSize total = 0;
+	VkDeviceSize largest_image = 0;
+	for (UploadBatch::BufferUpload const &upload : buffers) {
+		total += align_to(upload.size, 16);
+	}
+	//(images are staged with their levels padded apart; see staged_level_offsets)
+	std::vector< std::vector< VkDeviceSize > > image_level_offsets;
+	std::vector< VkDeviceSize > image_bytes;
+	for (UploadBatch::ImageUpload const &upload : images) {
+		VkDeviceSize bytes = 0;
+		image_level_offsets.emplace_back(staged_level_offsets(*upload.target, image_levels_given(*upload.target, upload.size, "transfer_batch"), &bytes));
+		image_bytes.emplace_back(bytes);
+		total += bytes + image_alignment(*upload.target);
+		largest_image = std::max(largest_image, bytes);
+	}
+	AllocatedBuffer staging = create_buffer(
+		std::max(std::min(total, TransferChunkSize), largest_image),
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		Mapped
+	);
+	char *staging_data = reinterpret_cast< char * >(staging.allocation.data());
+	VkDeviceSize const capacity = staging.size;
+
+	//per target buffer: the last upload that writes it, and whether some upload covers all of it.
+	// With a separate transfer family, a target is released to the graphics family only in the submit that finishes its last upload
+	// (the transfer queue must own it until then); and targets only written in part are copied on the graphics queue instead,
+	// since it may already own the rest of their contents (as in transfer_to_buffer).
+	struct BufferTarget {
+		size_t last_upload = 0;
+		bool written_whole = false;
+	};
+	std::unordered_map< AllocatedBuffer *, BufferTarget > buffer_targets;
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		BufferTarget &info = buffer_targets[buffers[i].target];
+		info.last_upload = i;
+		if (buffers[i].target_offset == 0 && buffers[i].size == buffers[i].target->size) info.written_whole = true;
+	}
+
+	//fill the staging buffer, record everything it holds, submit; repeat until the batch is done:
+	// (usually, once)
+	size_t next_image = 0;
+	size_t next_buffer = 0;
+	size_t buffer_done = 0; //bytes of buffers[next_buffer] already sent
+	while (next_image < images.size() || next_buffer < buffers.size()) {
+		VkDeviceSize used = 0;
+
+		//images first, since they can't be split: (an image always fits in an empty staging buffer)
+		struct StagedImage {
+			AllocatedImage *target;
+			VkDeviceSize offset;
+			std::vector< VkDeviceSize > const *level_offsets; //relative to offset
+			uint32_t levels_given;
+		};
+		std::vector< StagedImage > staged_images;
+		while (next_image < images.size()) {
+			UploadBatch::ImageUpload const &upload = images[next_image];
+			std::vector< VkDeviceSize > const &level_offsets = image_level_offsets[next_image];
+			VkDeviceSize offset = align_to(used, image_alignment(*upload.target));
+			if (offset + image_bytes[next_image] > capacity) break;
+			stage_levels(*upload.target, level_offsets, upload.data, staging_data + offset);
+			staged_images.emplace_back(StagedImage{
+				.target = upload.target,
+				.offset = offset,
+				.level_offsets = &level_offsets,
+				.levels_given = uint32_t(level_offsets.size()),
+			});
+			used = offset + image_bytes[next_image];
+			next_image += 1;
+		}
+
+		//then buffers, split wherever the staging buffer fills up:
+		// (regions are gathered per target buffer, so each target gets one vkCmdCopyBuffer)
+		struct StagedBuffer {
+			AllocatedBuffer *target;
+			std::vector< VkBufferCopy > regions;
+			bool on_graphics; //copied on the graphics queue (see BufferTarget above)
+			bool finished = false; //this submit writes the target's last piece
+		};
+		std::vector< StagedBuffer > staged_buffers;
+		std::unordered_map< AllocatedBuffer *, size_t > staged_buffer_index;
+		while (next_buffer < buffers.size()) {
+			VkDeviceSize offset = align_to(used, 16);
+			if (offset >= capacity) break;
+			UploadBatch::BufferUpload const &upload = buffers[next_buffer];
+			size_t piece = std::min< size_t >(upload.size - buffer_done, capacity - offset);
+			std::memcpy(staging_data + offset, reinterpret_cast< char const * >(upload.data) + buffer_done, piece);
+
+			auto [f, inserted] = staged_buffer_index.emplace(upload.target, staged_buffers.size());
+			BufferTarget const &info = buffer_targets.at(upload.target);
+			if (inserted) {
+				staged_buffers.emplace_back(StagedBuffer{
+					.target = upload.target,
+					.regions = {},
+					.on_graphics = separate_transfer_family() && !info.written_whole,
+				});
+			}
+			staged_buffers[f->second].regions.emplace_back(VkBufferCopy{
+				.srcOffset = offset,
+				.dstOffset = upload.target_offset + buffer_done,
+				.size = piece,
+			});
+
+			used = offset + piece;
+			buffer_done += piece;
+			if (buffer_done == upload.size) {
+				if (next_buffer == info.last_upload) staged_buffers[f->second].finished = true;
+				next_buffer += 1;
+				buffer_done = 0;
+			}
+		}
+
+		begin_transfer();
+
+		auto whole_image = [](AllocatedImage const &image) {
+			return VkImageSubresourceRange{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = image.mip_levels,
+				.baseArrayLayer = 0,
+				.layerCount = image.array_layers,
+			};
+		};
+
+		if (!staged_images.empty()) { //put the images in the right layout to receive copies:
+			std::vector< VkImageMemoryBarrier > barriers;
+			for (StagedImage const &staged : staged_images) {
+				barriers.emplace_back(VkImageMemoryBarrier{
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+					.srcAccessMask = 0,
+					.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+					.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+					.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.image = staged.target->handle,
+					.subresourceRange = whole_image(*staged.target),
+				});
+			}
+			vkCmdPipelineBarrier(transfer_command_buffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				uint32_t(barriers.size()), barriers.data()
+			);
+		}
+
+		//copies:
+		bool any_on_graphics = false;
+		for (StagedBuffer const &staged : staged_buffers) {
+			VkCommandBuffer command_buffer = (staged.on_graphics ? acquire_command_buffer : transfer_command_buffer);
+			vkCmdCopyBuffer(command_buffer, staging.handle, staged.target->handle, uint32_t(staged.regions.size()), staged.regions.data());
+			if (staged.on_graphics) any_on_graphics = true;
+		}
+		for (StagedImage const &staged : staged_images) {
+			AllocatedImage const &target = *staged.target;
+			std::vector< VkBufferImageCopy > regions;
+			for (uint32_t level = 0; level < staged.levels_given; ++level) {
+				regions.emplace_back(VkBufferImageCopy{
+					.bufferOffset = staged.offset + (*staged.level_offsets)[level],
+					.bufferRowLength = 0, //tightly packed
+					.bufferImageHeight = 0,
+					.imageSubresource{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = level,
+						.baseArrayLayer = 0,
+						.layerCount = target.array_layers,
+					},
+					.imageOffset{ .x = 0, .y = 0, .z = 0 },
+					.imageExtent{
+						.width = std::max(1u, target.extent.width >> level),
+						.height = std::max(1u, target.extent.height >> level),
+						.depth = 1
+					},
+				});
+			}
+			vkCmdCopyBufferToImage(transfer_command_buffer, staging.handle, target.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(regions.size()), regions.data());
+		}
+
+		//make the copies visible to later reads, and images ready for sampling: (handing off ownership if needed)
+		std::vector< VkImageMemoryBarrier > image_barriers;
+		for (StagedImage const &staged : staged_images) {
+			image_barriers.emplace_back(VkImageMemoryBarrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = staged.target->handle,
+				.subresourceRange = whole_image(*staged.target),
+			});
+		}
+		if (separate_transfer_family()) {
+			//buffers are only handed off once their last piece is written: (barriers cover everything earlier in submission order)
+			std::vector< VkBufferMemoryBarrier > buffer_barriers;
+			for (StagedBuffer const &staged : staged_buffers) {
+				if (staged.on_graphics || !staged.finished) continue;
+				buffer_barriers.emplace_back(VkBufferMemoryBarrier{
+					.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+					.dstAccessMask = 0, //ignored for a release
+					.srcQueueFamilyIndex = rtg.transfer_queue_family.value(),
+					.dstQueueFamilyIndex = rtg.graphics_queue_family.value(),
+					.buffer = staged.target->handle,
+					.offset = 0,
+					.size = VK_WHOLE_SIZE,
+				});
+			}
+			for (VkImageMemoryBarrier &barrier : image_barriers) {
+				barrier.srcQueueFamilyIndex = rtg.transfer_queue_family.value();
+				barrier.dstQueueFamilyIndex = rtg.graphics_queue_family.value();
+				barrier.dstAccessMask = 0; //ignored for a release
+			}
+
+			//release (image layout transitions happen once, between release and acquire):
+			vkCmdPipelineBarrier(transfer_command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr,
+				uint32_t(buffer_barriers.size()), buffer_barriers.data(),
+				uint32_t(image_barriers.size()), image_barriers.data()
+			);
+
+			//acquire:
+			for (VkBufferMemoryBarrier &barrier : buffer_barriers) {
+				barrier.srcAccessMask = 0; //ignored for an acquire
+				barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			}
+			for (VkImageMemoryBarrier &barrier : image_barriers) {
+				barrier.srcAccessMask = 0; //ignored for an acquire
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			}
+			vkCmdPipelineBarrier(acquire_command_buffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+				0, nullptr,
+				uint32_t(buffer_barriers.size()), buffer_barriers.data(),
+				uint32_t(image_barriers.size()), image_barriers.data()
+			);
+
+			//buffers copied on the graphics queue just need their writes made visible:
+			if (any_on_graphics) {
+				VkMemoryBarrier barrier{
+					.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+					.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+				};
+				vkCmdPipelineBarrier(acquire_command_buffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+					1, &barrier,
+					0, nullptr,
+					0, nullptr
+				);
+			}
+		} else {
+			//(one global barrier covers every buffer)
+			VkMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+			};
+			vkCmdPipelineBarrier(transfer_command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+				(staged_buffers.empty() ? 0 : 1), &barrier,
+				0, nullptr,
+				uint32_t(image_barriers.size()), image_barriers.data()
+			);
+		}
+
+		//fill in levels that weren't given, all images at once: (on the graphics queue, since blits need it)
+		std::vector< AllocatedImage * > mipmaps;
+		for (StagedImage const &staged : staged_images) {
+			if (staged.levels_given < staged.target->mip_levels) mipmaps.emplace_back(staged.target);
+		}
+		if (!mipmaps.empty()) {
+			generate_mipmaps(separate_transfer_family() ? acquire_command_buffer : transfer_command_buffer, mipmaps);
+		}
+
+		finish_transfer();
+	}
+
+	//don't need the staging buffer anymore:
+	destroy_buffer(std::move(staging));
+
+	batch = UploadBatch();
+}
+
+void Helpers::generate_mipmaps(VkCommandBuffer command_buffer, std::vector< AllocatedImage * > const &images) {
+	uint32_t max_levels = 1;
+	for (AllocatedImage *image : images) {
+		assert(image && image->handle != VK_NULL_HANDLE);
+		if (image->mip_levels <= 1) continue;
+		max_levels = std::max(max_levels, image->mip_levels);
+
+		//blits with a linear filter need format support:
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(rtg.physical_device, image->format, &properties);
+		VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		if ((properties.optimalTilingFeatures & needed) != needed) {
+			throw std::runtime_error(std::string("Helpers::generate_mipmaps: format ") + string_VkFormat(image->format) + " doesn't support linear blits; upload a pre-built mip chain instead.");
+		}
+	}
+	if (max_levels == 1) return;
+
+	std::vector< VkImageMemoryBarrier > barriers;
+	auto level_barrier = [&](AllocatedImage const &image, uint32_t base_level, uint32_t level_count, VkAccessFlags src_access, VkAccessFlags dst_access, VkImageLayout old_layout, VkImageLayout new_layout) {
+		barriers.emplace_back(VkImageMemoryBarrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = src_access,
+			.dstAccessMask = dst_access,
+			.oldLayout = old_layout,
+			.newLayout = new_layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image.handle,
+			.subresourceRange{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = base_level,
+				.levelCount = level_count,
+				.baseArrayLayer = 0,
+				.layerCount = image.array_layers,
+			},
+		});
+	};
+	auto flush_barriers = [&](VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage) {
+		if (barriers.empty()) return;
+		vkCmdPipelineBarrier(command_buffer,
+			src_stage, dst_stage, 0,
+			0, nullptr,
+			0, nullptr,
+			uint32_t(barriers.size()), barriers.data()
+		);
+		barriers.clear();
+	};
+
+	//level 0 becomes the first blit source; the other levels are about to be overwritten, so their contents can be dropped:
+	for (AllocatedImage *image : images) {
+		if (image->mip_levels <= 1) continue;
+		level_barrier(*image, 0, 1, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		level_barrier(*image, 1, image->mip_levels - 1, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	}
+	flush_barriers(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	//one round of blits per level, across all images, each followed by a single batch of barriers:
+	for (uint32_t level = 1; level < max_levels; ++level) {
+		for (AllocatedImage *image : images) {
+			if (level >= image->mip_levels) continue;
+			VkImageBlit blit{
+				.srcSubresource{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = level - 1,
+					.baseArrayLayer = 0,
+					.layerCount = image->array_layers,
+				},
+				.srcOffsets{
+					VkOffset3D{ .x = 0, .y = 0, .z = 0 },
+					VkOffset3D{ .x = int32_t(std::max(1u, image->extent.width >> (level - 1))), .y = int32_t(std::max(1u, image->extent.height >> (level - 1))), .z = 1 },
+				},
+				.dstSubresource{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = level,
+					.baseArrayLayer = 0,
+					.layerCount = image->array_layers,
+				},
+				.dstOffsets{
+					VkOffset3D{ .x = 0, .y = 0, .z = 0 },
+					VkOffset3D{ .x = int32_t(std::max(1u, image->extent.width >> level)), .y = int32_t(std::max(1u, image->extent.height >> level)), .z = 1 },
+				},
+			};
+			vkCmdBlitImage(command_buffer,
+				image->handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				image->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit,
+				VK_FILTER_LINEAR
+			);
+
+			//the level just written is the source for the next round:
+			level_barrier(*image, level, 1, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		}
+		flush_barriers(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+
+	//every level is now in TRANSFER_SRC_OPTIMAL; ready them for sampling:
+	for (AllocatedImage *image : images) {
+		if (image->mip_levels <= 1) continue;
+		level_barrier(*image, 0, image->mip_levels, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+	flush_barriers(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
+
+void Helpers::generate_mipmaps(std::vector< AllocatedImage * > const &images) {
+	begin_transfer();
+	//(transfer_command_buffer is only graphics-capable when the transfer family isn't separate)
+	generate_mipmaps(separate_transfer_family() ? acquire_command_buffer : transfer_command_buffer, images);
+	finish_transfer();
+}
+
+VkDeviceSize Helpers::stream_stage(void const *data, size_t size, VkDeviceSize alignment, char const *caller) {
+	StagingRing &ring = staging_ring;
+	if (ring.current_workspace == -1U) {
+		throw std::runtime_error(std::string("Helpers::") + caller + " called outside of a frame; use transfer_to_* instead.");
+	}
+	VkDeviceSize capacity = ring.buffer.size;
+
+	//align the offset within the ring: (alignment need not be a power of two, nor divide capacity)
+	VkDeviceSize lap = ring.written - ring.written % capacity;
+	VkDeviceSize offset = (ring.written % capacity + alignment - 1) / alignment * alignment;
+	//don't straddle the end of the ring; skip ahead to the start instead:
+	if (offset + size > capacity) {
+		lap += capacity;
+		offset = 0;
+	}
+	VkDeviceSize begin = lap + offset;
+	VkDeviceSize end = begin + size;
+	if (end - ring.released > capacity) {
+		throw std::runtime_error(std::string("Helpers::") + caller + ": staging ring is full (" + std::to_string(capacity) + " bytes); increase RTG::Configuration::staging_ring_size.");
+	}
+	ring.written = end;
+
+	//write directly into the mapped ring: (host writes to coherent memory are made visible by the submit)
+	std::memcpy(reinterpret_cast< char * >(ring.buffer.allocation.data()) + begin % capacity, data, size);
+
+	return begin % capacity;
+}
+
+void Helpers::stream_to_buffer(VkCommandBuffer command_buffer, void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset) {
+	assert(target_offset + size <= target.size);
+	if (size == 0) return;
+
+	VkBufferCopy region{
+		.srcOffset = stream_stage(data, size, 16, "stream_to_buffer"),
+		.dstOffset = target_offset,
+		.size = size,
+	};
+	vkCmdCopyBuffer(command_buffer, staging_ring.buffer.handle, target.handle, 1, &region);
+}
+
+void Helpers::stream_to_image(VkCommandBuffer command_buffer, void const *data, size_t size, AllocatedImage &target, uint32_t mip_level) {
+	assert(mip_level < target.mip_levels);
+	assert(size == mip_level_bytes(target, mip_level));
+
+	VkBufferImageCopy region{
+		//(copies to images need offsets that are a multiple of the texel block size, and of 4)
+		.bufferOffset = stream_stage(data, size, std::lcm< VkDeviceSize >(16, vkuFormatTexelBlockSize(target.format)), "stream_to_image"),
+		.bufferRowLength = 0, //tightly packed
+		.bufferImageHeight = 0,
+		.imageSubresource{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = mip_level,
+			.baseArrayLayer = 0,
+			.layerCount = target.array_layers,
+		},
+		.imageOffset{ .x = 0, .y = 0, .z = 0 },
+		.imageExtent{
+			.width = std::max(1u, target.extent.width >> mip_level),
+			.height = std::max(1u, target.extent.height >> mip_level),
+			.depth = 1
+		},
+	};
+	vkCmdCopyBufferToImage(command_buffer, staging_ring.buffer.handle, target.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+void Helpers::begin_workspace(uint32_t workspace_index) {
+	StagingRing &ring = staging_ring;
+	assert(workspace_index < ring.workspace_marks.size());
+
+	//everything streamed since the last workspace began was for that workspace:
+	if (ring.current_workspace != -1U) {
+		ring.workspace_marks[ring.current_workspace] = ring.written;
+	}
+
+	//this workspace's previous frame is done, so the GPU is done with everything it streamed:
+	// (earlier frames are done as well, so 'released' only needs to move forward)
+	ring.released = std::max(ring.released, ring.workspace_marks[workspace_index]);
+
+	ring.current_workspace = workspace_index;
+
+	//destroy anything that finished frames were using:
+	if (!deletion_queue.empty()) {
+		drain_deletion_queue(rtg.completed_frame());
+	}
+}
+
+//----------------------------
+
+void Helpers::destroy_buffer_later(AllocatedBuffer &&buffer) {
+	deletion_queue.emplace_back();
+	deletion_queue.back().frame = rtg.current_frame;
+	deletion_queue.back().buffer = std::move(buffer);
+	buffer.handle = VK_NULL_HANDLE;
+	buffer.size = 0;
+	buffer.bindless_index = -1U; //(stays registered until actually destroyed)
+}
+
+void Helpers::destroy_image_later(AllocatedImage &&image) {
+	deletion_queue.emplace_back();
+	deletion_queue.back().frame = rtg.current_frame;
+	deletion_queue.back().image = std::move(image);
+	image.handle = VK_NULL_HANDLE;
+	image.extent = VkExtent2D{.width = 0, .height = 0};
+	image.format = VK_FORMAT_UNDEFINED;
+	image.mip_levels = 1;
+	image.array_layers = 1;
+	image.bindless_index = -1U; //(stays registered until actually destroyed)
+	image.bindless_view = VK_NULL_HANDLE;
+}
+
+void Helpers::destroy_later(std::function< void() > const &destroy) {
+	deletion_queue.emplace_back();
+	deletion_queue.back().frame = rtg.current_frame;
+	deletion_queue.back().destroy = destroy;
+}
+
+void Helpers::drain_deletion_queue(uint64_t completed_frame) {
+	while (!deletion_queue.empty() && deletion_queue.front().frame <= completed_frame) {
+		DeferredDestruction &deferred = deletion_queue.front();
+		if (deferred.buffer.handle != VK_NULL_HANDLE) {
+			destroy_buffer(std::move(deferred.buffer));
+		}
+		if (deferred.image.handle != VK_NULL_HANDLE) {
+			destroy_image(std::move(deferred.image));
+		}
+		if (deferred.destroy) {
+			deferred.destroy();
+		}
+		deletion_queue.pop_front();
+	}
+}
+
+//----------------------------
+
+uint32_t Helpers::register_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	if (bindless.set == VK_NULL_HANDLE) throw std::runtime_error("Bindless heap is not available (device lacks descriptor indexing support).");
+
+	uint32_t index;
+	if (!bindless.free_buffers.empty()) {
+		index = bindless.free_buffers.back();
+		bindless.free_buffers.pop_back();
+	} else if (bindless.next_buffer < bindless.buffer_capacity) {
+		index = bindless.next_buffer++;
+	} else {
+		throw std::runtime_error("Bindless heap is out of buffer slots (" + std::to_string(bindless.buffer_capacity) + ").");
+	}
+
+	VkDescriptorBufferInfo buffer_info{
+		.buffer = buffer,
+		.offset = offset,
+		.range = range,
+	};
+	VkWriteDescriptorSet write{
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = bindless.set,
+		.dstBinding = BindlessBuffersBinding,
+		.dstArrayElement = index,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = &buffer_info,
+	};
+	vkUpdateDescriptorSets(rtg.device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+uint32_t Helpers::register_image(VkImageView view, VkSampler sampler) {
+	if (bindless.set == VK_NULL_HANDLE) throw std::runtime_error("Bindless heap is not available (device lacks descriptor indexing support).");
+
+	uint32_t index;
+	if (!bindless.free_images.empty()) {
+		index = bindless.free_images.back();
+		bindless.free_images.pop_back();
+	} else if (bindless.next_image < bindless.image_capacity) {
+		index = bindless.next_image++;
+	} else {
+		throw std::runtime_error("Bindless heap is out of image slots (" + std::to_string(bindless.image_capacity) + ").");
+	}
+
+	VkDescriptorImageInfo image_info{
+		.sampler = (sampler != VK_NULL_HANDLE ? sampler : bindless.sampler),
+		.imageView = view,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	};
+	VkWriteDescriptorSet write{
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = bindless.set,
+		.dstBinding = BindlessImagesBinding,
+		.dstArrayElement = index,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.pImageInfo = &image_info,
+	};
+	vkUpdateDescriptorSets(rtg.device, 1, &write, 0, nullptr);
+
+	return index;
+}
+
+//(the stale descriptor is left in place -- the arrays are partially bound, so unused entries needn't be valid)
+void Helpers::unregister_buffer(uint32_t index) {
+	assert(index < bindless.next_buffer);
+	bindless.free_buffers.emplace_back(index);
+}
+
+void Helpers::unregister_image(uint32_t index) {
+	assert(index < bindless.next_image);
+	bindless.free_images.emplace_back(index);
 }
 
 //----------------------------
 
+Helpers::FrameArena Helpers::create_frame_arena(VkDeviceSize size) {
+	FrameArena arena;
+	arena.buffer = create_buffer(
+		size,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		Dynamic
+	);
+	assert(arena.buffer.allocation.mapped != nullptr); //(Dynamic memory is always mapped)
+	//(the offset alignments are powers of two, so the larger one satisfies both)
+	arena.alignment = std::max< VkDeviceSize >({
+		limits.minUniformBufferOffsetAlignment,
+		limits.minStorageBufferOffsetAlignment,
+		16, //plenty for vertex and index data
+	});
+	arena.used = 0;
+	return arena;
+}
+
+Helpers::FrameAllocation Helpers::frame_allocate(FrameArena &arena, VkDeviceSize size) {
+	assert(arena.buffer.handle != VK_NULL_HANDLE);
+
+	VkDeviceSize offset = (arena.used + arena.alignment - 1) / arena.alignment * arena.alignment;
+	if (offset + size > arena.buffer.size) {
+		throw std::runtime_error("Helpers::frame_allocate: arena is full (" + std::to_string(arena.buffer.size) + " bytes, " + std::to_string(offset) + " used, " + std::to_string(size) + " requested).");
+	}
+	arena.used = offset + size;
+
+	return FrameAllocation{
+		.buffer = arena.buffer.handle,
+		.offset = offset,
+		.data = reinterpret_cast< char * >(arena.buffer.allocation.data()) + offset,
+	};
+}
+
+void Helpers::reset_frame_arena(FrameArena &arena) {
+	arena.used = 0;
+}
+
+void Helpers::destroy_frame_arena(FrameArena &&arena) {
+	if (arena.buffer.handle != VK_NULL_HANDLE) {
+		destroy_buffer(std::move(arena.buffer));
+	}
+	arena.used = 0;
+	arena.alignment = 1;
+}
+
+//----------------------------
+
+//helper: make one more pool for a DescriptorAllocator's chain:
+static VkDescriptorPool create_chained_pool(VkDevice device, Helpers::DescriptorAllocator const &allocator) {
+	VkDescriptorPoolCreateInfo create_info{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = 0, //no FREE_DESCRIPTOR_SET_BIT -- sets are only ever freed by resetting the pool
+		.maxSets = allocator.max_sets,
+		.poolSizeCount = uint32_t(allocator.pool_sizes.size()),
+		.pPoolSizes = allocator.pool_sizes.data(),
+	};
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VK( vkCreateDescriptorPool(device, &create_info, nullptr, &pool) );
+	return pool;
+}
+
+Helpers::DescriptorAllocator Helpers::create_descriptor_allocator(std::vector< VkDescriptorPoolSize > const &pool_sizes, uint32_t max_sets) {
+	assert(max_sets > 0);
+
+	DescriptorAllocator allocator;
+	allocator.pool_sizes = pool_sizes;
+	allocator.max_sets = max_sets;
+	allocator.pools.emplace_back(create_chained_pool(rtg.device, allocator));
+	allocator.current = 0;
+	return allocator;
+}
+
+VkDescriptorSet Helpers::allocate_descriptor_set(DescriptorAllocator &allocator, VkDescriptorSetLayout layout) {
+	assert(allocator.current < allocator.pools.size());
+
+	VkDescriptorSetAllocateInfo alloc_info{
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = VK_NULL_HANDLE, //set below
+		.descriptorSetCount = 1,
+		.pSetLayouts = &layout,
+	};
+
+	bool fresh = false; //is pools[current] unused since the last reset?
+	while (true) {
+		alloc_info.descriptorPool = allocator.pools[allocator.current];
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		VkResult result = vkAllocateDescriptorSets(rtg.device, &alloc_info, &set);
+		if (result == VK_SUCCESS) return set;
+
+		if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+			throw std::runtime_error(std::string("Helpers::allocate_descriptor_set: vkAllocateDescriptorSets failed [") + string_VkResult(result) + "].");
+		}
+		if (fresh) {
+			throw std::runtime_error("Helpers::allocate_descriptor_set: set does not fit in an empty pool; increase the DescriptorAllocator's pool sizes.");
+		}
+
+		//this pool is full, move on to the next one in the chain:
+		allocator.current += 1;
+		if (allocator.current == allocator.pools.size()) {
+			allocator.pools.emplace_back(create_chained_pool(rtg.device, allocator));
+		}
+		fresh = true;
+	}
+}
+
+void Helpers::reset_descriptor_allocator(DescriptorAllocator &allocator) {
+	//only pools up to current have been allocated from:
+	for (uint32_t i = 0; i <= allocator.current && i < allocator.pools.size(); ++i) {
+		VK( vkResetDescriptorPool(rtg.device, allocator.pools[i], 0) );
+	}
+	allocator.current = 0;
+}
+
+void Helpers::destroy_descriptor_allocator(DescriptorAllocator &&allocator) {
+	//(destroying a pool frees all of its sets)
+	for (VkDescriptorPool pool : allocator.pools) {
+		vkDestroyDescriptorPool(rtg.device, pool, nullptr);
+	}
+	allocator.pools.clear();
+	allocator.current = 0;
+	allocator.pool_sizes.clear();
+	allocator.max_sets = 0;
+}
+
+//----------------------------
+
+uint32_t Helpers::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags flags) const {
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+		VkMemoryType const &type = memory_properties.memoryTypes[i];
+		if ((type_filter & (1 << i)) != 0
+		 && (type.propertyFlags & flags) == flags) {
+			return i;
+		}
+	}
+	throw std::runtime_error("No suitable memory type found.");
+}
+
+uint32_t Helpers::find_memory_type(uint32_t type_filter, MemoryUsage usage) const {
+	constexpr VkMemoryPropertyFlags DeviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	constexpr VkMemoryPropertyFlags HostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	constexpr VkMemoryPropertyFlags HostCached = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	//device-local + host-visible heaps at least this big aren't just the classic 256MiB BAR window:
+	constexpr VkDeviceSize LargeHeap = VkDeviceSize(512) * 1024 * 1024;
+
+	//first type that has all of 'want' and none of 'avoid' (with a big enough heap), or -1U:
+	auto find = [&](VkMemoryPropertyFlags want, VkMemoryPropertyFlags avoid, VkDeviceSize min_heap = 0) -> uint32_t {
+		for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+			VkMemoryType const &type = memory_properties.memoryTypes[i];
+			if ((type_filter & (1 << i)) == 0) continue;
+			if ((type.propertyFlags & want) != want) continue;
+			if ((type.propertyFlags & avoid) != 0) continue;
+			if (memory_properties.memoryHeaps[type.heapIndex].size < min_heap) continue;
+			return i;
+		}
+		return -1U;
+	};
+
+	//candidates, best first:
+	uint32_t found = -1U;
+	if (usage == Upload) {
+		found = find(DeviceLocal | HostVisible, 0, LargeHeap);
+	}
+	if (usage == GpuOnly || usage == Upload) {
+		//(avoid host-visible device-local types so a small BAR window isn't used up by things that are never mapped)
+		if (found == -1U) found = find(DeviceLocal, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		if (found == -1U) found = find(DeviceLocal, 0);
+		if (found == -1U) found = find(0, 0);
+	} else if (usage == Readback) {
+		if (found == -1U) found = find(HostVisible | HostCached, 0);
+		if (found == -1U) found = find(HostVisible, 0);
+	} else if (usage == Dynamic) {
+		if (found == -1U) found = find(DeviceLocal | HostVisible, 0);
+		if (found == -1U) found = find(HostVisible, 0);
+	}
+
+	if (found == -1U) throw std::runtime_error("No suitable memory type found for memory usage " + std::to_string(int(usage)) + ".");
+	return found;
+}
+
 VkFormat Helpers::find_image_format(std::vector< VkFormat > const &candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const {
 	return refsol::Helpers_find_image_format(rtg, candidates, tiling, features);
 }
@@ -92,7 +1671,249 @@ Helpers::~Helpers() {
 }
 
 void Helpers::create() {
+	vkGetPhysicalDeviceMemoryProperties(rtg.physical_device, &memory_properties);
+
+	type_allocated.assign(memory_properties.memoryTypeCount, 0);
+	heap_reserved.assign(memory_properties.memoryHeapCount, 0);
+
+	{ //device limits, for alignment:
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(rtg.physical_device, &properties);
+		limits = properties.limits;
+	}
+
+	//choose a block size per memory type based on the size of its heap:
+	block_sizes.assign(memory_properties.memoryTypeCount, 0);
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+		VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[i].heapIndex].size;
+		//64MiB blocks, except on small heaps (e.g., 256MiB device-local+host-visible windows) where blocks are an eighth of the heap:
+		block_sizes[i] = std::min< VkDeviceSize >(64 * 1024 * 1024, heap_size / 8);
+	}
+
+	{ //command buffers and sync for transfer_to_*:
+		VkCommandPoolCreateInfo pool_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = rtg.transfer_queue_family.value(),
+		};
+		VK( vkCreateCommandPool(rtg.device, &pool_info, nullptr, &transfer_command_pool) );
+
+		VkCommandBufferAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = transfer_command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VK( vkAllocateCommandBuffers(rtg.device, &alloc_info, &transfer_command_buffer) );
+
+		if (separate_transfer_family()) {
+			pool_info.queueFamilyIndex = rtg.graphics_queue_family.value();
+			VK( vkCreateCommandPool(rtg.device, &pool_info, nullptr, &acquire_command_pool) );
+
+			alloc_info.commandPool = acquire_command_pool;
+			VK( vkAllocateCommandBuffers(rtg.device, &alloc_info, &acquire_command_buffer) );
+
+			VkSemaphoreCreateInfo semaphore_info{
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			};
+			VK( vkCreateSemaphore(rtg.device, &semaphore_info, nullptr, &transfer_done) );
+		}
+
+		VkFenceCreateInfo fence_info{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		};
+		VK( vkCreateFence(rtg.device, &fence_info, nullptr, &transfer_fence) );
+	}
+
+	//bindless heap: (if the device supports it; see RTG's feature selection)
+	if (rtg.enabled_features_12.descriptorBindingPartiallyBound) {
+		VkPhysicalDeviceVulkan12Properties properties_12{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES,
+		};
+		VkPhysicalDeviceProperties2 properties{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &properties_12,
+		};
+		vkGetPhysicalDeviceProperties2(rtg.physical_device, &properties);
+
+		bindless.buffer_capacity = std::min({
+			BindlessMaxBuffers,
+			properties_12.maxDescriptorSetUpdateAfterBindStorageBuffers,
+			properties_12.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+			properties_12.maxPerStageUpdateAfterBindResources / 4, //(leave most of the per-stage budget for images)
+		});
+		bindless.image_capacity = std::min({
+			BindlessMaxImages,
+			properties_12.maxDescriptorSetUpdateAfterBindSampledImages,
+			properties_12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			properties_12.maxDescriptorSetUpdateAfterBindSamplers,
+			properties_12.maxPerStageDescriptorUpdateAfterBindSamplers,
+			properties_12.maxPerStageUpdateAfterBindResources - bindless.buffer_capacity,
+		});
+
+		std::array< VkDescriptorSetLayoutBinding, 2 > bindings{
+			VkDescriptorSetLayoutBinding{
+				.binding = BindlessBuffersBinding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = bindless.buffer_capacity,
+				.stageFlags = VK_SHADER_STAGE_ALL,
+			},
+			VkDescriptorSetLayoutBinding{
+				.binding = BindlessImagesBinding,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorCount = bindless.image_capacity, //(upper bound; the actual count is given at allocation)
+				.stageFlags = VK_SHADER_STAGE_ALL,
+			},
+		};
+		VkDescriptorBindingFlags common_flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+		                                      | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT
+		                                      | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+		std::array< VkDescriptorBindingFlags, 2 > binding_flags{
+			common_flags,
+			common_flags | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT, //(only allowed on the last binding)
+		};
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+			.bindingCount = uint32_t(binding_flags.size()),
+			.pBindingFlags = binding_flags.data(),
+		};
+		VkDescriptorSetLayoutCreateInfo layout_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = &flags_info,
+			.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+			.bindingCount = uint32_t(bindings.size()),
+			.pBindings = bindings.data(),
+		};
+		VK( vkCreateDescriptorSetLayout(rtg.device, &layout_info, nullptr, &bindless.layout) );
+
+		std::array< VkDescriptorPoolSize, 2 > pool_sizes{
+			VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = bindless.buffer_capacity },
+			VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = bindless.image_capacity },
+		};
+		VkDescriptorPoolCreateInfo pool_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+			.maxSets = 1,
+			.poolSizeCount = uint32_t(pool_sizes.size()),
+			.pPoolSizes = pool_sizes.data(),
+		};
+		VK( vkCreateDescriptorPool(rtg.device, &pool_info, nullptr, &bindless.pool) );
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfo count_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+			.descriptorSetCount = 1,
+			.pDescriptorCounts = &bindless.image_capacity,
+		};
+		VkDescriptorSetAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = &count_info,
+			.descriptorPool = bindless.pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &bindless.layout,
+		};
+		VK( vkAllocateDescriptorSets(rtg.device, &alloc_info, &bindless.set) );
+
+		VkSamplerCreateInfo sampler_info{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.magFilter = VK_FILTER_LINEAR,
+			.minFilter = VK_FILTER_LINEAR,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+			.mipLodBias = 0.0f,
+			.anisotropyEnable = VK_FALSE,
+			.compareEnable = VK_FALSE,
+			.minLod = 0.0f,
+			.maxLod = VK_LOD_CLAMP_NONE,
+			.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+			.unnormalizedCoordinates = VK_FALSE,
+		};
+		VK( vkCreateSampler(rtg.device, &sampler_info, nullptr, &bindless.sampler) );
+
+		bindless.next_buffer = bindless.next_image = 0;
+		bindless.free_buffers.clear();
+		bindless.free_images.clear();
+	}
+
+	//staging ring for stream_to_buffer:
+	staging_ring.buffer = create_buffer(
+		rtg.configuration.staging_ring_size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		Mapped
+	);
+	staging_ring.written = 0;
+	staging_ring.released = 0;
+	staging_ring.workspace_marks.assign(rtg.configuration.workspaces, 0);
+	staging_ring.current_workspace = -1U;
 }
 
 void Helpers::destroy() {
+	//the device is idle, so everything queued can go:
+	drain_deletion_queue(UINT64_MAX);
+
+	if (staging_ring.buffer.handle != VK_NULL_HANDLE) {
+		destroy_buffer(std::move(staging_ring.buffer));
+	}
+	staging_ring.workspace_marks.clear();
+	staging_ring.current_workspace = -1U;
+
+	if (bindless.next_buffer != bindless.free_buffers.size() || bindless.next_image != bindless.free_images.size()) {
+		std::cerr << "Destroying bindless heap with " << (bindless.next_buffer - bindless.free_buffers.size()) << " buffers and " << (bindless.next_image - bindless.free_images.size()) << " images still registered." << std::endl;
+	}
+	if (bindless.pool != VK_NULL_HANDLE) {
+		//(frees bindless.set as well)
+		vkDestroyDescriptorPool(rtg.device, bindless.pool, nullptr);
+		bindless.pool = VK_NULL_HANDLE;
+		bindless.set = VK_NULL_HANDLE;
+	}
+	if (bindless.layout != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(rtg.device, bindless.layout, nullptr);
+		bindless.layout = VK_NULL_HANDLE;
+	}
+	if (bindless.sampler != VK_NULL_HANDLE) {
+		vkDestroySampler(rtg.device, bindless.sampler, nullptr);
+		bindless.sampler = VK_NULL_HANDLE;
+	}
+	bindless.free_buffers.clear();
+	bindless.free_images.clear();
+	bindless.next_buffer = bindless.next_image = 0;
+
+	if (transfer_fence != VK_NULL_HANDLE) {
+		vkDestroyFence(rtg.device, transfer_fence, nullptr);
+		transfer_fence = VK_NULL_HANDLE;
+	}
+	if (transfer_done != VK_NULL_HANDLE) {
+		vkDestroySemaphore(rtg.device, transfer_done, nullptr);
+		transfer_done = VK_NULL_HANDLE;
+	}
+	if (acquire_command_pool != VK_NULL_HANDLE) {
+		//(frees acquire_command_buffer as well)
+		vkDestroyCommandPool(rtg.device, acquire_command_pool, nullptr);
+		acquire_command_pool = VK_NULL_HANDLE;
+		acquire_command_buffer = VK_NULL_HANDLE;
+	}
+	if (transfer_command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(rtg.device, transfer_command_pool, nullptr);
+		transfer_command_pool = VK_NULL_HANDLE;
+		transfer_command_buffer = VK_NULL_HANDLE;
+	}
+
+	//anything still in a block was leaked by the application:
+	for (auto &[handle, block] : memory_blocks) {
+		if (block.used != 0) {
+			std::cerr << "Destroying a memory block with " << block.used << " bytes still allocated; some resource was leaked." << std::endl;
+		}
+		if (block.mapped) vkUnmapMemory(rtg.device, block.handle);
+		vkFreeMemory(rtg.device, block.handle, nullptr);
+	}
+	memory_blocks.clear();
+
+	if (!dedicated_allocations.empty()) {
+		std::cerr << "Helpers::destroy with " << dedicated_allocations.size() << " dedicated allocations still live; some resource was leaked." << std::endl;
+	}
+	dedicated_allocations.clear();
+	type_allocated.clear();
+	heap_reserved.clear();
 }
@@ -2,6 +2,12 @@
 
 #include <vulkan/vulkan_core.h>
 
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <unordered_map>
 #include <vector>
 
 struct RTG;
@@ -31,39 +37,307 @@ struct Helpers {
 		Mapped = 1,
 	};
 
+	//passed to create_buffer/create_image to register the resource in the bindless heap (see below):
+	enum BindlessFlag {
+		NotBindless = 0,
+		Bindless = 1,
+	};
+
+	//What a resource's memory is for; used to pick a memory type instead of spelling out VkMemoryPropertyFlags:
+	// (every host-visible type picked this way is also host-coherent, so mapped writes need no flushing)
+	enum MemoryUsage {
+		GpuOnly = 0, //only the GPU touches it (render targets, buffers filled by copies); device-local, never mapped
+		Upload = 1, //written by the CPU once (or rarely), read by the GPU a lot; device-local, and mapped if a large
+		            // device-local + host-visible heap exists (resizable BAR, integrated GPUs) -- otherwise filled via staging
+		Readback = 2, //written by the GPU, read by the CPU; host-cached if possible, always mapped
+		Dynamic = 3, //rewritten by the CPU every frame; device-local + host-visible if any such type exists (even a small BAR window), always mapped
+	};
+
+	//Resources with linear and optimal tiling are kept in separate blocks so that they never violate bufferImageGranularity:
+	enum TilingKind {
+		LinearTiling = 0, //buffers and VK_IMAGE_TILING_LINEAR images
+		OptimalTiling = 1, //VK_IMAGE_TILING_OPTIMAL images
+	};
+
+	//Allocate a chunk of device memory:
+	// (small requests are sub-allocated from shared blocks; large ones get their own VkDeviceMemory)
+	Allocation allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t memory_type_index, MapFlag map = Unmapped, TilingKind tiling = LinearTiling);
+	Allocation allocate(VkMemoryRequirements const &requirements, VkMemoryPropertyFlags memory_properties, MapFlag map = Unmapped, TilingKind tiling = LinearTiling);
+	void free(Allocation &&allocation);
+
 	//specializations that also create a buffer or image (respectively):
 	struct AllocatedBuffer {
 		VkBuffer handle = VK_NULL_HANDLE;
 		VkDeviceSize size = 0; //bytes in the buffer (allocation.size might be larger)
 		Allocation allocation;
+		uint32_t bindless_index = -1U; //index in the bindless heap's buffer array (-1U if not registered)
 
 		//NOTE: could define default constructor, move constructor, move assignment, destructor for a bit more paranoia
 	};
-	AllocatedBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map = Unmapped);
+	//(Bindless buffers also get VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+	AllocatedBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map = Unmapped, BindlessFlag bindless = NotBindless);
+	//version that picks memory by intent; the buffer is mapped iff its memory is host-visible (check allocation.mapped).
+	// (GpuOnly, Upload, and Readback buffers also get VK_BUFFER_USAGE_TRANSFER_DST_BIT, so transfer_to_buffer can always fill them)
+	AllocatedBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage, BindlessFlag bindless = NotBindless);
 	void destroy_buffer(AllocatedBuffer &&allocated_buffer);
 
 	struct AllocatedImage {
 		VkImage handle = VK_NULL_HANDLE;
 		VkExtent2D extent{.width = 0, .height = 0};
 		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t mip_levels = 1;
+		uint32_t array_layers = 1;
 		Allocation allocation;
+		uint32_t bindless_index = -1U; //index in the bindless heap's image array (-1U if not registered)
+		VkImageView bindless_view = VK_NULL_HANDLE; //whole-image view used by the bindless heap (owned by Helpers)
 
 		//NOTE: could define default constructor, move constructor, move assignment, destructor for a bit more paranoia
 	};
-	AllocatedImage create_image(VkExtent2D const &extent, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map = Unmapped);
+	//(Bindless images also get VK_IMAGE_USAGE_SAMPLED_BIT, and are expected to be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when sampled;
+	// their bindless view covers every mip level of layer 0, since the heap's image array is sampler2D)
+	//(images with more than one mip level also get VK_IMAGE_USAGE_TRANSFER_SRC_BIT and _DST_BIT, for generate_mipmaps)
+	AllocatedImage create_image(VkExtent2D const &extent, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, MapFlag map = Unmapped, BindlessFlag bindless = NotBindless, uint32_t mip_levels = 1, uint32_t array_layers = 1);
+	//number of levels in a full mip chain for an image of this size: (pass as create_image's mip_levels)
+	static uint32_t full_mip_levels(VkExtent2D const &extent);
+	//bytes of tightly-packed data for one mip level (all array layers) of an image:
+	static size_t mip_level_bytes(AllocatedImage const &image, uint32_t level);
 	void destroy_image(AllocatedImage &&allocated_image);
-	
+
+	//-----------------------
+	//deferred destruction:
+	// destroy_buffer and destroy_image are only safe when the GPU is done with the resource (e.g., after vkDeviceWaitIdle).
+	// These versions instead queue the resource, and destroy it once every frame up to RTG::current_frame is done.
+	// The queue is drained by begin_workspace (so, from RTG::run's main loop) and by destroy().
+	void destroy_buffer_later(AllocatedBuffer &&allocated_buffer);
+	void destroy_image_later(AllocatedImage &&allocated_image);
+	void destroy_later(std::function< void() > const &destroy); //for anything else (image views, framebuffers, ...)
+
+	struct DeferredDestruction {
+		uint64_t frame = 0; //safe to destroy once this frame is done
+		AllocatedBuffer buffer; //destroyed if handle is not null
+		AllocatedImage image; //destroyed if handle is not null
+		std::function< void() > destroy; //called if set
+	};
+	std::deque< DeferredDestruction > deletion_queue; //in frame order (frame numbers only ever increase)
+	void drain_deletion_queue(uint64_t completed_frame); //destroy everything whose frame is <= completed_frame
+
+	//-----------------------
+	//bindless descriptor heap:
+	// A single descriptor set holding large, partially-bound arrays of every registered resource:
+	//   layout(set = S, binding = 0) buffer ... buffers[]; //storage buffers
+	//   layout(set = S, binding = 1) uniform sampler2D images[]; //combined image samplers (variable count)
+	// Include bindless.layout in pipeline layouts and bind bindless.set once per command buffer; draws then pick
+	// resources by index (e.g., from push constants or an instance buffer) instead of binding their own sets.
+	// Indices are stable until the resource is unregistered (destroy_* does this). Entries may be written while
+	// the set is in use by the GPU (update-after-bind), as long as in-flight work doesn't use those entries.
+	// Only available if the device supports descriptor indexing (check bindless.set != VK_NULL_HANDLE).
+	static constexpr uint32_t BindlessBuffersBinding = 0;
+	static constexpr uint32_t BindlessImagesBinding = 1;
+	static constexpr uint32_t BindlessMaxBuffers = 16384; //array sizes (further limited by device limits)
+	static constexpr uint32_t BindlessMaxImages = 65536;
+
+	uint32_t register_buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE); //returns index; throws when full
+	uint32_t register_image(VkImageView view, VkSampler sampler = VK_NULL_HANDLE); //(null sampler means bindless.sampler)
+	void unregister_buffer(uint32_t index);
+	void unregister_image(uint32_t index);
+
+	struct BindlessHeap {
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE; //default sampler: linear filtering, repeat addressing
+		uint32_t buffer_capacity = 0, image_capacity = 0; //array sizes
+		uint32_t next_buffer = 0, next_image = 0; //indices at or past these have never been used
+		std::vector< uint32_t > free_buffers, free_images; //unregistered indices, reused first
+	} bindless;
+
+	//-----------------------
+	//per-frame dynamic data:
+	// A FrameArena is a persistently mapped, host-coherent buffer that is bump-allocated from during a frame and
+	// recycled all at once (reset_frame_arena) when the frame that used it is done -- e.g., one arena per workspace,
+	// reset at the start of the workspace's render. Writes go straight to the mapped memory; there is no staging copy.
+	// Allocations are aligned for use as uniform or storage buffers with dynamic offsets (and as vertex/index data).
+	struct FrameArena {
+		AllocatedBuffer buffer; //host-visible, coherent, persistently mapped
+		VkDeviceSize alignment = 1; //every allocation starts at a multiple of this
+		VkDeviceSize used = 0; //bytes handed out since the last reset
+	};
+	struct FrameAllocation {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0; //in buffer; pass as a dynamic offset or to vkCmdBind*Buffers
+		void *data = nullptr; //write here
+	};
+	FrameArena create_frame_arena(VkDeviceSize size);
+	FrameAllocation frame_allocate(FrameArena &arena, VkDeviceSize size); //throws if the arena is full
+	void reset_frame_arena(FrameArena &arena); //recycles everything allocated since the last reset
+	void destroy_frame_arena(FrameArena &&arena);
+
+	//-----------------------
+	//transient descriptor sets:
+	// A DescriptorAllocator hands out sets from a chain of pools; sets are never freed individually.
+	// Instead, the whole chain is reset at once (vkResetDescriptorPool) when everything allocated from it is done,
+	// e.g., at the start of a workspace's render, since the workspace's previous frame has finished by then.
+	// When a pool runs out, the next pool in the chain is used (and created if needed); pools are kept across resets,
+	// so after a few frames the chain is long enough for the busiest frame and no more pools get made.
+	struct DescriptorAllocator {
+		std::vector< VkDescriptorPoolSize > pool_sizes; //descriptors of each type in every pool
+		uint32_t max_sets = 0; //sets per pool
+		std::vector< VkDescriptorPool > pools; //the chain
+		uint32_t current = 0; //pool that allocations are tried from; pools after this are unused since the last reset
+
+		//NOTE: could define default constructor, move constructor, move assignment, destructor for a bit more paranoia
+	};
+	DescriptorAllocator create_descriptor_allocator(std::vector< VkDescriptorPoolSize > const &pool_sizes, uint32_t max_sets);
+	VkDescriptorSet allocate_descriptor_set(DescriptorAllocator &allocator, VkDescriptorSetLayout layout); //throws if the set doesn't fit in an empty pool
+	void reset_descriptor_allocator(DescriptorAllocator &allocator); //frees every set allocated since the last reset
+	void destroy_descriptor_allocator(DescriptorAllocator &&allocator);
+
+	//-----------------------
+	//memory statistics:
+	struct MemoryStats {
+		struct Heap {
+			VkDeviceSize size = 0; //total size of the heap
+			VkDeviceSize reserved = 0; //VkDeviceMemory held by Helpers (blocks + dedicated allocations)
+			VkDeviceSize allocated = 0; //bytes of that handed out as Allocations
+			uint32_t blocks = 0; //shared blocks
+			uint32_t dedicated = 0; //allocations with their own VkDeviceMemory
+			float fragmentation = 0.0f; //over this heap's blocks: 1 - (largest free range / free bytes); 0 means all free space is contiguous
+			//from VK_EXT_memory_budget, or 0 if not supported:
+			VkDeviceSize budget = 0; //how much this process can use before things get slow (or fail)
+			VkDeviceSize usage = 0; //how much this process is using (including memory not allocated through Helpers)
+		};
+		std::vector< Heap > heaps; //indexed by memory heap
+		std::vector< VkDeviceSize > type_allocated; //bytes handed out as Allocations, indexed by memory type
+	};
+	MemoryStats memory_stats() const;
+	void report_memory(std::ostream &out) const; //prints a one-line summary of memory_stats() (RTG::run does this every Configuration::memory_report_interval seconds)
+
+	//-----------------------
+	//Memory arena internals:
+
+	//A block of VkDeviceMemory from which many Allocations are sub-allocated:
+	struct MemoryBlock {
+		VkDeviceMemory handle = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memory_type_index = 0;
+		TilingKind tiling = LinearTiling;
+		void *mapped = nullptr; //whole block is mapped (persistently) the first time a Mapped allocation is made from it
+		std::map< VkDeviceSize, VkDeviceSize > free_ranges; //offset -> size; adjacent ranges are always merged
+		VkDeviceSize used = 0; //bytes handed out (including alignment padding)
+	};
+	std::unordered_map< VkDeviceMemory, MemoryBlock > memory_blocks;
+
+	//size of new blocks, indexed by memory type; allocations larger than half a block get their own VkDeviceMemory:
+	// (set per memory heap in create(), so small heaps aren't eaten by one block)
+	std::vector< VkDeviceSize > block_sizes;
+
+	//accounting: (kept up to date by allocate and free)
+	std::unordered_map< VkDeviceMemory, uint32_t > dedicated_allocations; //memory type index of each allocation that got its own VkDeviceMemory
+	std::vector< VkDeviceSize > type_allocated; //bytes handed out as Allocations, per memory type
+	std::vector< VkDeviceSize > heap_reserved; //bytes of VkDeviceMemory held (blocks + dedicated), per memory heap
+	//called before every vkAllocateMemory; throws if the allocation would go past RTG::Configuration::memory_limit (or the heap's budget):
+	void check_memory_limit(uint32_t memory_type_index, VkDeviceSize size) const;
+
+	VkPhysicalDeviceMemoryProperties memory_properties{}; //filled in by create()
+	VkPhysicalDeviceLimits limits{}; //filled in by create()
 
 	//-----------------------
 	//CPU -> GPU data transfer:
 
-	// NOTE: synchronizes *hard* against the GPU; inefficient to use for streaming data!
-	void transfer_to_buffer(void const *data, size_t size, AllocatedBuffer &target);
+	// NOTE: synchronizes *hard* against the GPU; inefficient to use for streaming data! (and for many small uploads, see UploadBatch below)
+	// transfer_to_buffer writes directly if target is mapped (e.g., an Upload buffer in resizable-BAR memory); no copy is recorded then.
+	// Otherwise, copies run on rtg.transfer_queue; if that is a separate family, ownership is handed to the graphics queue family before returning.
+	// (writes to only part of a buffer run on the graphics queue instead, since it may already own the rest of the buffer's contents)
+	// Large transfers are staged in TransferChunkSize pieces, so a multi-gigabyte upload never needs a multi-gigabyte staging buffer.
+	void transfer_to_buffer(void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset = 0);
+	static constexpr VkDeviceSize TransferChunkSize = 64 * 1024 * 1024;
+	//transfer_to_image takes tightly packed data, level by level (largest first), with every array layer of a level together.
+	// data can be either every mip level (a pre-built chain, copied in one go) or just level 0 (then the remaining levels are made by generate_mipmaps).
 	void transfer_to_image(void const *data, size_t size, AllocatedImage &image); //NOTE: image layout after call is VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	//how many levels transfer_to_image-style data holds (1 or image.mip_levels); throws if size fits neither:
+	static uint32_t image_levels_given(AllocatedImage const &image, size_t size, char const *caller);
+
+	//Batched version of transfer_to_*, for loading many small things at once:
+	//  Helpers::UploadBatch batch;
+	//  for (Mesh &mesh : meshes) batch.add(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex), mesh.buffer);
+	//  batch.add(pixels.data(), pixels.size(), texture);
+	//  helpers.transfer_batch(batch); //one staging buffer, one command buffer, one submit (and one wait)
+	// Data is packed into a staging buffer of up to TransferChunkSize bytes (or the largest image, if that is bigger);
+	// batches that don't fit go out in as few submits as it takes. Data and targets are only read at transfer_batch, so must stay valid until then.
+	// Afterward, images are in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL (with mip levels generated if only level 0 was given), exactly as with transfer_to_*.
+	// Queue ownership follows transfer_to_buffer: a buffer split across submits is handed to the graphics queue family only after its last piece.
+	struct UploadBatch {
+		struct BufferUpload {
+			void const *data;
+			size_t size;
+			AllocatedBuffer *target;
+			VkDeviceSize target_offset;
+		};
+		struct ImageUpload {
+			void const *data;
+			size_t size; //base level only or whole chain (see transfer_to_image)
+			AllocatedImage *target;
+		};
+		std::vector< BufferUpload > buffers;
+		std::vector< ImageUpload > images;
+
+		void add(void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset = 0);
+		void add(void const *data, size_t size, AllocatedImage &target); //(throws if size is wrong for the image)
+		bool empty() const { return buffers.empty() && images.empty(); }
+	};
+	void transfer_batch(UploadBatch &batch); //clears batch when done
+
+	//Fill levels 1+ of each image by repeatedly blitting (linear filter) from the level above, batched so that each level
+	// is one round of blits across all the images. Images must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with level 0 filled
+	// (e.g., after transfer_to_image), and are left in that layout. Requires a graphics-capable command buffer and a color
+	// format that supports linear-filtered blits (so, not block-compressed formats; those need pre-built chains).
+	void generate_mipmaps(VkCommandBuffer command_buffer, std::vector< AllocatedImage * > const &images);
+	void generate_mipmaps(std::vector< AllocatedImage * > const &images); //records, submits, and waits (like transfer_to_*)
+
+	//Streaming alternative: copies data into a persistently mapped staging ring and records a copy into command_buffer.
+	// Returns immediately; all uploads recorded into a command buffer go out with its (single) submit.
+	// Staging space is reclaimed when the current workspace is next available, so:
+	//  - only call while RTG::run is rendering a frame, with a command buffer that is submitted for the current workspace
+	//  - all of a frame's uploads must fit in RTG::Configuration::staging_ring_size (throws otherwise)
+	// NOTE: the caller is responsible for a barrier between the copy (VK_ACCESS_TRANSFER_WRITE_BIT) and later uses of target.
+	void stream_to_buffer(VkCommandBuffer command_buffer, void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset = 0);
+	//same, for one mip level (every array layer, tightly packed) of an image that is already in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+	// (layout transitions before and after are also up to the caller)
+	void stream_to_image(VkCommandBuffer command_buffer, void const *data, size_t size, AllocatedImage &target, uint32_t mip_level);
+
+	//transfer_to_* internals:
+	VkCommandPool transfer_command_pool = VK_NULL_HANDLE; //for rtg.transfer_queue_family
+	VkCommandBuffer transfer_command_buffer = VK_NULL_HANDLE; //records copies + ownership release
+	VkCommandPool acquire_command_pool = VK_NULL_HANDLE; //for rtg.graphics_queue_family (only if transfer family is separate)
+	VkCommandBuffer acquire_command_buffer = VK_NULL_HANDLE; //records ownership acquire on the graphics queue
+	VkSemaphore transfer_done = VK_NULL_HANDLE; //transfer submit -> acquire submit handoff
+	VkFence transfer_fence = VK_NULL_HANDLE; //signal'd when the whole transfer (including acquire) is done
+	bool separate_transfer_family() const;
+	void begin_transfer(); //reset + begin command buffers
+	void finish_transfer(); //end, submit, and wait for command buffers
+
+	//Staging ring internals:
+	// Positions are "virtual" byte counts that only ever increase; the ring offset is position % buffer.size.
+	struct StagingRing {
+		AllocatedBuffer buffer; //host-visible, coherent, persistently mapped
+		VkDeviceSize written = 0; //position after the last byte handed out
+		VkDeviceSize released = 0; //position before which the GPU is done with everything
+		std::vector< VkDeviceSize > workspace_marks; //value of 'written' when each workspace was last finished with
+		uint32_t current_workspace = -1U; //workspace that new uploads belong to (-1U outside of frames)
+	} staging_ring;
+	VkDeviceSize stream_stage(void const *data, size_t size, VkDeviceSize alignment, char const *caller); //copy data into the ring at a multiple of alignment; returns its offset in ring.buffer
+
+	//called by RTG::run when a workspace is available again (its previous frame is done) and is about to be used:
+	// (also drains the deletion queue)
+	void begin_workspace(uint32_t workspace_index);
 
 	//-----------------------
 	//Misc utilities:
 
+	//for selecting memory types: (throws if none match)
+	uint32_t find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags flags) const;
+	uint32_t find_memory_type(uint32_t type_filter, MemoryUsage usage) const; //best type for the intent
+
 	//for selecting image formats:
 	VkFormat find_image_format(std::vector< VkFormat > const &candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const;
 
@@ -0,0 +1,511 @@
+#include "KTX2.hpp"
+
+#include "WorkerPool.hpp"
+
+#include <vulkan/utility/vk_format_utils.h> //for block sizes
+#include <vulkan/vk_enum_string_helper.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+//----------------------------
+//Container parsing:
+
+//bytes of one tightly packed level (all layers) of a format + size:
+static size_t level_bytes(VkFormat format, VkExtent2D extent, uint32_t level, uint32_t layers) {
+	uint32_t width = std::max(1u, extent.width >> level);
+	uint32_t height = std::max(1u, extent.height >> level);
+	VkExtent3D block = vkuFormatTexelBlockExtent(format);
+	size_t blocks_wide = (width + block.width - 1) / block.width;
+	size_t blocks_high = (height + block.height - 1) / block.height;
+	return blocks_wide * blocks_high * vkuFormatTexelBlockSize(format) * layers;
+}
+
+KTX2 KTX2::load(std::string const &filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) throw std::runtime_error("Failed to open KTX2 file '" + filename + "'.");
+	std::vector< uint8_t > file((std::istreambuf_iterator< char >(in)), std::istreambuf_iterator< char >());
+
+	auto fail = [&](std::string const &why) -> std::runtime_error {
+		return std::runtime_error("KTX2 file '" + filename + "' " + why);
+	};
+
+	//(KTX2 is little-endian, as is everything this code runs on)
+	auto read = [&]< typename T >(size_t offset, T *value) {
+		if (offset + sizeof(T) > file.size()) throw fail("is truncated.");
+		std::memcpy(value, file.data() + offset, sizeof(T));
+	};
+
+	static constexpr std::array< uint8_t, 12 > Identifier{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	if (file.size() < Identifier.size() || !std::equal(Identifier.begin(), Identifier.end(), file.begin())) {
+		throw fail("doesn't start with the KTX2 identifier.");
+	}
+
+	//header:
+	//(typeSize, at 16, only matters for endian conversion)
+	uint32_t vk_format, pixel_width, pixel_height, pixel_depth, layer_count, face_count, level_count, supercompression_scheme;
+	read(12, &vk_format);
+	read(20, &pixel_width);
+	read(24, &pixel_height);
+	read(28, &pixel_depth);
+	read(32, &layer_count);
+	read(36, &face_count);
+	read(40, &level_count);
+	read(44, &supercompression_scheme);
+	//(index at 48..80 locates the data format descriptor, key/value data, and supercompression data -- none of which are needed here)
+	constexpr size_t LevelIndexOffset = 80;
+
+	if (vk_format == VK_FORMAT_UNDEFINED) throw fail("has no vkFormat (Basis Universal payloads aren't supported).");
+	if (supercompression_scheme != 0) throw fail("uses supercompression scheme " + std::to_string(supercompression_scheme) + " (only uncompressed payloads are supported).");
+	if (pixel_width == 0) throw fail("has zero width.");
+	if (pixel_depth > 1) throw fail("is a 3D texture (only 2D textures, arrays, and cube maps are supported).");
+	if (face_count != 1 && face_count != 6) throw fail("has " + std::to_string(face_count) + " faces (should be 1 or 6).");
+
+	KTX2 ktx;
+	ktx.format = VkFormat(vk_format);
+	ktx.extent = VkExtent2D{ .width = pixel_width, .height = std::max(1u, pixel_height) };
+	ktx.faces = face_count;
+	ktx.array_layers = std::max(1u, layer_count) * face_count;
+	ktx.generate_mips = (level_count == 0);
+	ktx.mip_levels = std::max(1u, level_count);
+
+	if (vkuFormatTexelBlockSize(ktx.format) == 0 || vkuFormatIsMultiplane(ktx.format)) {
+		throw fail(std::string("has format ") + string_VkFormat(ktx.format) + ", which isn't a single-plane format.");
+	}
+	if (ktx.mip_levels > Helpers::full_mip_levels(ktx.extent)) {
+		throw fail("has " + std::to_string(ktx.mip_levels) + " mip levels, more than a " + std::to_string(ktx.extent.width) + "x" + std::to_string(ktx.extent.height) + " image can have.");
+	}
+
+	//block-compressed textures must be made of whole blocks, or the smaller levels don't line up:
+	VkExtent3D block = vkuFormatTexelBlockExtent(ktx.format);
+	if (ktx.extent.width % block.width != 0 || ktx.extent.height % block.height != 0) {
+		throw fail("is " + std::to_string(ktx.extent.width) + "x" + std::to_string(ktx.extent.height) + ", which isn't a multiple of " + string_VkFormat(ktx.format) + "'s " + std::to_string(block.width) + "x" + std::to_string(block.height) + " blocks.");
+	}
+
+	//gather levels (the file may store them in any order; the level index lists level 0 first):
+	std::vector< size_t > offsets(ktx.mip_levels);
+	size_t total = 0;
+	for (uint32_t level = 0; level < ktx.mip_levels; ++level) {
+		offsets[level] = total;
+		total += level_bytes(ktx.format, ktx.extent, level, ktx.array_layers);
+	}
+	ktx.data.resize(total);
+
+	for (uint32_t level = 0; level < ktx.mip_levels; ++level) {
+		//(each entry is byteOffset, byteLength, uncompressedByteLength; the last only matters with supercompression)
+		uint64_t byte_offset, byte_length;
+		read(LevelIndexOffset + 24 * level + 0, &byte_offset);
+		read(LevelIndexOffset + 24 * level + 8, &byte_length);
+
+		size_t expected = level_bytes(ktx.format, ktx.extent, level, ktx.array_layers);
+		if (byte_length != expected) {
+			throw fail("level " + std::to_string(level) + " has " + std::to_string(byte_length) + " bytes, but should have " + std::to_string(expected) + ".");
+		}
+		if (byte_offset > file.size() || byte_length > file.size() - byte_offset) {
+			throw fail("level " + std::to_string(level) + " extends past the end of the file.");
+		}
+		std::memcpy(ktx.data.data() + offsets[level], file.data() + byte_offset, byte_length);
+	}
+
+	return ktx;
+}
+
+//----------------------------
+//Uploading:
+
+Helpers::AllocatedImage KTX2::upload(Helpers &helpers, WorkerPool *workers, Helpers::BindlessFlag bindless) {
+	prepare(helpers, workers);
+
+	Helpers::AllocatedImage image = helpers.create_image(
+		extent,
+		format,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		Helpers::Unmapped,
+		bindless,
+		image_mip_levels(),
+		array_layers
+	);
+	//(if only level 0 is present, transfer_to_image generates the rest)
+	helpers.transfer_to_image(data.data(), data.size(), image);
+
+	return image;
+}
+
+void KTX2::prepare(Helpers const &helpers, WorkerPool *workers) {
+	VkFormatFeatureFlags features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+
+	//prefer the file's format; fall back to CPU-decoding it if that's possible:
+	std::vector< VkFormat > candidates{ format };
+	VkFormat fallback = bc_fallback_format(format);
+	if (fallback != VK_FORMAT_UNDEFINED) candidates.emplace_back(fallback);
+
+	VkFormat chosen = helpers.find_image_format(candidates, VK_IMAGE_TILING_OPTIMAL, features);
+	if (chosen != format) {
+		assert(chosen == fallback);
+		decode_bc(workers);
+	}
+}
+
+//----------------------------
+//CPU decoding of block-compressed formats:
+// (each decoder writes one 4x4 block of texels to out, with the given stride between rows)
+
+VkFormat KTX2::bc_fallback_format(VkFormat format) {
+	switch (format) {
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+			return VK_FORMAT_R8G8B8A8_UNORM;
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return VK_FORMAT_R8G8B8A8_SRGB;
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+			return VK_FORMAT_R8_UNORM;
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+			return VK_FORMAT_R8G8_UNORM;
+		default:
+			//(BC4/BC5 SNORM and BC6H have no CPU decoder)
+			return VK_FORMAT_UNDEFINED;
+	}
+}
+
+//BC1 color block (also the color half of BC2 and BC3, which always use four colors):
+static void decode_bc1_block(uint8_t const *block, uint8_t *out, size_t stride, bool four_colors) {
+	uint16_t c0 = uint16_t(block[0] | (block[1] << 8));
+	uint16_t c1 = uint16_t(block[2] | (block[3] << 8));
+	uint32_t indices = uint32_t(block[4]) | (uint32_t(block[5]) << 8) | (uint32_t(block[6]) << 16) | (uint32_t(block[7]) << 24);
+
+	auto expand = [](uint16_t c, uint8_t *rgba) {
+		uint32_t r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+		rgba[0] = uint8_t((r << 3) | (r >> 2));
+		rgba[1] = uint8_t((g << 2) | (g >> 4));
+		rgba[2] = uint8_t((b << 3) | (b >> 2));
+		rgba[3] = 255;
+	};
+	uint8_t palette[4][4];
+	expand(c0, palette[0]);
+	expand(c1, palette[1]);
+	for (uint32_t c = 0; c < 3; ++c) {
+		if (four_colors || c0 > c1) {
+			palette[2][c] = uint8_t((2 * palette[0][c] + palette[1][c] + 1) / 3);
+			palette[3][c] = uint8_t((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+		} else {
+			palette[2][c] = uint8_t((palette[0][c] + palette[1][c] + 1) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = (four_colors || c0 > c1 ? 255 : 0);
+
+	for (uint32_t i = 0; i < 16; ++i) {
+		std::memcpy(out + (i / 4) * stride + (i % 4) * 4, palette[(indices >> (2 * i)) & 3], 4);
+	}
+}
+
+//BC4 block (also BC3's alpha and each of BC5's channels); writes one byte every 'step' bytes:
+static void decode_bc4_block(uint8_t const *block, uint8_t *out, size_t stride, size_t step) {
+	uint8_t palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+	if (palette[0] > palette[1]) {
+		for (uint32_t i = 1; i < 7; ++i) palette[i + 1] = uint8_t(((7 - i) * palette[0] + i * palette[1] + 3) / 7);
+	} else {
+		for (uint32_t i = 1; i < 5; ++i) palette[i + 1] = uint8_t(((5 - i) * palette[0] + i * palette[1] + 2) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (uint32_t b = 0; b < 6; ++b) indices |= uint64_t(block[2 + b]) << (8 * b);
+	for (uint32_t i = 0; i < 16; ++i) {
+		out[(i / 4) * stride + (i % 4) * step] = palette[(indices >> (3 * i)) & 7];
+	}
+}
+
+//BC2 explicit alpha: 4 bits per texel:
+static void decode_bc2_alpha(uint8_t const *block, uint8_t *out, size_t stride) {
+	for (uint32_t i = 0; i < 16; ++i) {
+		uint32_t a = (block[i / 2] >> (4 * (i % 2))) & 0xf;
+		out[(i / 4) * stride + (i % 4) * 4 + 3] = uint8_t(a * 17);
+	}
+}
+
+//BC7 tables, from the BPTC format description in the Khronos Data Format Specification:
+static constexpr uint16_t BC7Partitions2[64] = { //bit i is the subset of texel i
+	0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+	0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+	0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+	0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+static constexpr uint8_t BC7Partitions3[64][16] = {
+	{0,0,1,1,0,0,1,1,0,2,2,1,2,2,2,2}, {0,0,0,1,0,0,1,1,2,2,1,1,2,2,2,1}, {0,0,0,0,2,0,0,1,2,2,1,1,2,2,1,1}, {0,2,2,2,0,0,2,2,0,0,1,1,0,1,1,1},
+	{0,0,0,0,0,0,0,0,1,1,2,2,1,1,2,2}, {0,0,1,1,0,0,1,1,0,0,2,2,0,0,2,2}, {0,0,2,2,0,0,2,2,1,1,1,1,1,1,1,1}, {0,0,1,1,0,0,1,1,2,2,1,1,2,2,1,1},
+	{0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2}, {0,0,0,0,1,1,1,1,1,1,1,1,2,2,2,2}, {0,0,0,0,1,1,1,1,2,2,2,2,2,2,2,2}, {0,0,1,2,0,0,1,2,0,0,1,2,0,0,1,2},
+	{0,1,1,2,0,1,1,2,0,1,1,2,0,1,1,2}, {0,1,2,2,0,1,2,2,0,1,2,2,0,1,2,2}, {0,0,1,1,0,1,1,2,1,1,2,2,1,2,2,2}, {0,0,1,1,2,0,0,1,2,2,0,0,2,2,2,0},
+	{0,0,0,1,0,0,1,1,0,1,1,2,1,1,2,2}, {0,1,1,1,0,0,1,1,2,0,0,1,2,2,0,0}, {0,0,0,0,1,1,2,2,1,1,2,2,1,1,2,2}, {0,0,2,2,0,0,2,2,0,0,2,2,1,1,1,1},
+	{0,1,1,1,0,1,1,1,0,2,2,2,0,2,2,2}, {0,0,0,1,0,0,0,1,2,2,2,1,2,2,2,1}, {0,0,0,0,0,0,1,1,0,1,2,2,0,1,2,2}, {0,0,0,0,1,1,0,0,2,2,1,0,2,2,1,0},
+	{0,1,2,2,0,1,2,2,0,0,1,1,0,0,0,0}, {0,0,1,2,0,0,1,2,1,1,2,2,2,2,2,2}, {0,1,1,0,1,2,2,1,1,2,2,1,0,1,1,0}, {0,0,0,0,0,1,1,0,1,2,2,1,1,2,2,1},
+	{0,0,2,2,1,1,0,2,1,1,0,2,0,0,2,2}, {0,1,1,0,0,1,1,0,2,0,0,2,2,2,2,2}, {0,0,1,1,0,1,2,2,0,1,2,2,0,0,1,1}, {0,0,0,0,2,0,0,0,2,2,1,1,2,2,2,1},
+	{0,0,0,0,0,0,0,2,1,1,2,2,1,2,2,2}, {0,2,2,2,0,0,2,2,0,0,1,2,0,0,1,1}, {0,0,1,1,0,0,1,2,0,0,2,2,0,2,2,2}, {0,1,2,0,0,1,2,0,0,1,2,0,0,1,2,0},
+	{0,0,0,0,1,1,1,1,2,2,2,2,0,0,0,0}, {0,1,2,0,1,2,0,1,2,0,1,2,0,1,2,0}, {0,1,2,0,2,0,1,2,1,2,0,1,0,1,2,0}, {0,0,1,1,2,2,0,0,1,1,2,2,0,0,1,1},
+	{0,0,1,1,1,1,2,2,2,2,0,0,0,0,1,1}, {0,1,0,1,0,1,0,1,2,2,2,2,2,2,2,2}, {0,0,0,0,0,0,0,0,2,1,2,1,2,1,2,1}, {0,0,2,2,1,1,2,2,0,0,2,2,1,1,2,2},
+	{0,0,2,2,0,0,1,1,0,0,2,2,0,0,1,1}, {0,2,2,0,1,2,2,1,0,2,2,0,1,2,2,1}, {0,1,0,1,2,2,2,2,2,2,2,2,0,1,0,1}, {0,0,0,0,2,1,2,1,2,1,2,1,2,1,2,1},
+	{0,1,0,1,0,1,0,1,0,1,0,1,2,2,2,2}, {0,2,2,2,0,1,1,1,0,2,2,2,0,1,1,1}, {0,0,0,2,1,1,1,2,0,0,0,2,1,1,1,2}, {0,0,0,0,2,1,1,2,2,1,1,2,2,1,1,2},
+	{0,2,2,2,0,1,1,1,0,1,1,1,0,2,2,2}, {0,0,0,2,1,1,1,2,1,1,1,2,0,0,0,2}, {0,1,1,0,0,1,1,0,0,1,1,0,2,2,2,2}, {0,0,0,0,0,0,0,0,2,1,1,2,2,1,1,2},
+	{0,1,1,0,0,1,1,0,2,2,2,2,2,2,2,2}, {0,0,2,2,0,0,1,1,0,0,1,1,0,0,2,2}, {0,0,2,2,1,1,2,2,1,1,2,2,0,0,2,2}, {0,0,0,0,0,0,0,0,0,0,0,0,2,1,1,2},
+	{0,0,0,2,0,0,0,1,0,0,0,2,0,0,0,1}, {0,2,2,2,1,2,2,2,0,2,2,2,1,2,2,2}, {0,1,0,1,2,2,2,2,2,2,2,2,2,2,2,2}, {0,1,1,1,2,0,1,1,2,2,0,1,2,2,2,0},
+};
+//anchor (first-index) texel of subset 1 in two-subset partitions, and of subsets 1 and 2 in three-subset partitions:
+// (subset 0's anchor is always texel 0)
+static constexpr uint8_t BC7Anchors2[64] = {
+	15,15,15,15,15,15,15,15, 15,15,15,15,15,15,15,15, 15, 2, 8, 2, 2, 8, 8,15,  2, 8, 2, 2, 8, 8, 2, 2,
+	15,15, 6, 8, 2, 8,15,15,  2, 8, 2, 2, 2,15,15, 6,  6, 2, 6, 8,15,15, 2, 2, 15,15,15,15,15, 2, 2,15,
+};
+static constexpr uint8_t BC7Anchors3a[64] = {
+	 3, 3,15,15, 8, 3,15,15,  8, 8, 6, 6, 6, 5, 3, 3,  3, 3, 8,15, 3, 3, 6,10,  5, 8, 8, 6, 8, 5,15,15,
+	 8,15, 3, 5, 6,10, 8,15, 15, 3,15, 5,15,15,15,15,  3,15, 5, 5, 5, 8, 5,10,  5,10, 8,13,15,12, 3, 3,
+};
+static constexpr uint8_t BC7Anchors3b[64] = {
+	15, 8, 8, 3,15,15, 3, 8, 15,15,15,15,15,15,15, 8, 15, 8,15, 3,15, 8,15, 8,  3,15, 6,10,15,15,10, 8,
+	15, 3,15,10,10, 8, 9,10,  6,15, 8,15, 3, 6, 6, 8, 15, 3,15,15,15,15,15,15, 15,15,15,15, 3,15,15, 8,
+};
+static constexpr uint8_t BC7Weights2[4] = { 0, 21, 43, 64 };
+static constexpr uint8_t BC7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static constexpr uint8_t BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BC7Mode {
+	uint8_t subsets, partition_bits, rotation_bits, index_selection_bits, color_bits, alpha_bits, endpoint_pbits, shared_pbits, index_bits, index_bits2;
+};
+static constexpr BC7Mode BC7Modes[8] = {
+	{3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+	{2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+	{3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+	{2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+	{1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+	{1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+	{1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+	{2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+};
+
+static void decode_bc7_block(uint8_t const *block, uint8_t *out, size_t stride) {
+	//bits are read least-significant first:
+	uint32_t position = 0;
+	auto bits = [&](uint32_t count) -> uint32_t {
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < count; ++i, ++position) {
+			value |= uint32_t((block[position / 8] >> (position % 8)) & 1) << i;
+		}
+		return value;
+	};
+
+	uint32_t mode_index = 0;
+	while (mode_index < 8 && bits(1) == 0) ++mode_index;
+	if (mode_index == 8) {
+		//reserved mode; decodes to transparent black:
+		for (uint32_t i = 0; i < 16; ++i) std::memset(out + (i / 4) * stride + (i % 4) * 4, 0, 4);
+		return;
+	}
+	BC7Mode const &mode = BC7Modes[mode_index];
+
+	uint32_t partition = bits(mode.partition_bits);
+	uint32_t rotation = bits(mode.rotation_bits);
+	uint32_t index_selection = bits(mode.index_selection_bits);
+
+	//endpoints, channel by channel:
+	uint32_t endpoint_count = 2 * mode.subsets;
+	uint32_t endpoints[6][4];
+	for (uint32_t c = 0; c < 3; ++c) {
+		for (uint32_t e = 0; e < endpoint_count; ++e) endpoints[e][c] = bits(mode.color_bits);
+	}
+	for (uint32_t e = 0; e < endpoint_count; ++e) endpoints[e][3] = (mode.alpha_bits ? bits(mode.alpha_bits) : 255);
+
+	//p-bits extend every channel by one low bit:
+	uint32_t pbits[6] = {};
+	if (mode.endpoint_pbits) {
+		for (uint32_t e = 0; e < endpoint_count; ++e) pbits[e] = bits(1);
+	} else if (mode.shared_pbits) {
+		for (uint32_t s = 0; s < mode.subsets; ++s) pbits[2 * s] = pbits[2 * s + 1] = bits(1);
+	}
+	bool has_pbits = (mode.endpoint_pbits || mode.shared_pbits);
+
+	//expand to 8 bits by replicating the high bits into the low ones:
+	for (uint32_t e = 0; e < endpoint_count; ++e) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			uint32_t count = (c < 3 ? mode.color_bits : mode.alpha_bits);
+			if (count == 0) continue; //(alpha stays 255)
+			uint32_t v = endpoints[e][c];
+			if (has_pbits) {
+				v = (v << 1) | pbits[e];
+				count += 1;
+			}
+			v <<= (8 - count);
+			endpoints[e][c] = v | (v >> count);
+		}
+	}
+
+	//which subset each texel is in, and which texels are anchors (those store one fewer index bit):
+	auto subset_of = [&](uint32_t i) -> uint32_t {
+		if (mode.subsets == 2) return (BC7Partitions2[partition] >> i) & 1;
+		if (mode.subsets == 3) return BC7Partitions3[partition][i];
+		return 0;
+	};
+	auto is_anchor = [&](uint32_t i) -> bool {
+		if (i == 0) return true;
+		if (mode.subsets == 2) return i == BC7Anchors2[partition];
+		if (mode.subsets == 3) return i == BC7Anchors3a[partition] || i == BC7Anchors3b[partition];
+		return false;
+	};
+
+	uint32_t indices[16], indices2[16] = {};
+	for (uint32_t i = 0; i < 16; ++i) indices[i] = bits(mode.index_bits - (is_anchor(i) ? 1 : 0));
+	if (mode.index_bits2) {
+		for (uint32_t i = 0; i < 16; ++i) indices2[i] = bits(mode.index_bits2 - (i == 0 ? 1 : 0));
+	}
+
+	auto weight = [](uint32_t index_bits, uint32_t index) -> uint32_t {
+		if (index_bits == 2) return BC7Weights2[index];
+		if (index_bits == 3) return BC7Weights3[index];
+		return BC7Weights4[index];
+	};
+	auto interpolate = [](uint32_t e0, uint32_t e1, uint32_t w) -> uint8_t {
+		return uint8_t(((64 - w) * e0 + w * e1 + 32) >> 6);
+	};
+
+	for (uint32_t i = 0; i < 16; ++i) {
+		uint32_t s = subset_of(i);
+		uint32_t const *e0 = endpoints[2 * s];
+		uint32_t const *e1 = endpoints[2 * s + 1];
+
+		//modes 4 and 5 have separate color and alpha indices (mode 4's index selection bit swaps them):
+		uint32_t color_weight, alpha_weight;
+		if (mode.index_bits2 == 0) {
+			color_weight = alpha_weight = weight(mode.index_bits, indices[i]);
+		} else if (index_selection == 0) {
+			color_weight = weight(mode.index_bits, indices[i]);
+			alpha_weight = weight(mode.index_bits2, indices2[i]);
+		} else {
+			color_weight = weight(mode.index_bits2, indices2[i]);
+			alpha_weight = weight(mode.index_bits, indices[i]);
+		}
+
+		uint8_t rgba[4] = {
+			interpolate(e0[0], e1[0], color_weight),
+			interpolate(e0[1], e1[1], color_weight),
+			interpolate(e0[2], e1[2], color_weight),
+			interpolate(e0[3], e1[3], alpha_weight),
+		};
+		//rotation swaps alpha with one of the color channels:
+		if (rotation != 0) std::swap(rgba[3], rgba[rotation - 1]);
+
+		std::memcpy(out + (i / 4) * stride + (i % 4) * 4, rgba, 4);
+	}
+}
+
+void KTX2::decode_bc(WorkerPool *workers) {
+	VkFormat to = bc_fallback_format(format);
+	if (to == VK_FORMAT_UNDEFINED) {
+		throw std::runtime_error(std::string("KTX2::decode_bc: no CPU decoder for ") + string_VkFormat(format) + ".");
+	}
+	VkFormat from = format;
+	size_t texel_bytes = vkuFormatTexelBlockSize(to);
+	size_t block_bytes = vkuFormatTexelBlockSize(from);
+
+	//where every level starts, before and after decoding:
+	std::vector< size_t > from_offsets, to_offsets;
+	size_t from_total = 0, to_total = 0;
+	for (uint32_t level = 0; level < mip_levels; ++level) {
+		from_offsets.emplace_back(from_total);
+		to_offsets.emplace_back(to_total);
+		from_total += level_bytes(from, extent, level, array_layers);
+		to_total += level_bytes(to, extent, level, array_layers);
+	}
+	assert(from_total == data.size());
+	std::vector< uint8_t > decoded(to_total);
+
+	//decode one level (every layer) -- levels write disjoint ranges, so they can run in parallel:
+	auto decode_level = [&, from, texel_bytes, block_bytes](uint32_t level) {
+		uint32_t width = std::max(1u, extent.width >> level);
+		uint32_t height = std::max(1u, extent.height >> level);
+		uint32_t blocks_wide = (width + 3) / 4, blocks_high = (height + 3) / 4;
+
+		uint8_t const *src = data.data() + from_offsets[level];
+		uint8_t *dst_level = decoded.data() + to_offsets[level];
+		size_t row_bytes = width * texel_bytes;
+
+		//blocks are decoded to a 4x4 scratch area, then cropped (small levels are smaller than a block):
+		uint8_t scratch[4 * 4 * 4];
+		for (uint32_t layer = 0; layer < array_layers; ++layer) {
+			uint8_t *dst = dst_level + layer * row_bytes * height;
+			for (uint32_t by = 0; by < blocks_high; ++by) {
+				for (uint32_t bx = 0; bx < blocks_wide; ++bx, src += block_bytes) {
+					size_t stride = 4 * texel_bytes;
+					switch (from) {
+						case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+						case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+							decode_bc1_block(src, scratch, stride, false);
+							for (uint32_t i = 0; i < 16; ++i) scratch[(i / 4) * stride + (i % 4) * 4 + 3] = 255; //(no alpha in RGB variant)
+							break;
+						case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+						case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+							decode_bc1_block(src, scratch, stride, false);
+							break;
+						case VK_FORMAT_BC2_UNORM_BLOCK:
+						case VK_FORMAT_BC2_SRGB_BLOCK:
+							decode_bc1_block(src + 8, scratch, stride, true);
+							decode_bc2_alpha(src, scratch, stride);
+							break;
+						case VK_FORMAT_BC3_UNORM_BLOCK:
+						case VK_FORMAT_BC3_SRGB_BLOCK:
+							decode_bc1_block(src + 8, scratch, stride, true);
+							decode_bc4_block(src, scratch + 3, stride, 4);
+							break;
+						case VK_FORMAT_BC4_UNORM_BLOCK:
+							decode_bc4_block(src, scratch, stride, 1);
+							break;
+						case VK_FORMAT_BC5_UNORM_BLOCK:
+							decode_bc4_block(src, scratch, stride, 2);
+							decode_bc4_block(src + 8, scratch + 1, stride, 2);
+							break;
+						case VK_FORMAT_BC7_UNORM_BLOCK:
+						case VK_FORMAT_BC7_SRGB_BLOCK:
+							decode_bc7_block(src, scratch, stride);
+							break;
+						default:
+							assert(0 && "bc_fallback_format and decode_bc disagree");
+					}
+					uint32_t copy_w = std::min(4u, width - bx * 4);
+					uint32_t copy_h = std::min(4u, height - by * 4);
+					for (uint32_t y = 0; y < copy_h; ++y) {
+						std::memcpy(dst + (by * 4 + y) * row_bytes + bx * 4 * texel_bytes, scratch + y * stride, copy_w * texel_bytes);
+					}
+				}
+			}
+		}
+	};
+
+	if (workers) {
+		for (uint32_t level = 0; level < mip_levels; ++level) {
+			workers->run([&decode_level, level](){ decode_level(level); });
+		}
+		workers->wait_idle();
+	} else {
+		for (uint32_t level = 0; level < mip_levels; ++level) {
+			decode_level(level);
+		}
+	}
+
+	format = to;
+	data = std::move(decoded);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+//Textures stored in KTX2 containers ( https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html ):
+//
+//  KTX2 texture = KTX2::load("brick.ktx2"); //parse + validate; throws on error
+//  Helpers::AllocatedImage image = texture.upload(rtg.helpers, &workers); //picks a format, copies every level
+//
+// Supported: 2D textures (and arrays / cube faces, as array layers) with any vkFormat -- uncompressed or block-compressed --
+// and no supercompression (so not Basis Universal or zstd payloads).
+// Block-compressed data is uploaded as-is. If the device can't sample a BCn format, upload decodes it on the CPU
+// (BC1-5 and BC7; one job per mip level on the given WorkerPool) into an uncompressed format instead.
+
+#include "Helpers.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct WorkerPool;
+
+struct KTX2 {
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent{.width = 0, .height = 0};
+	uint32_t mip_levels = 1; //levels in data
+	uint32_t array_layers = 1; //layers in each level (layer * faces + face, for cube maps)
+	uint32_t faces = 1; //6 for cube maps (the image needs VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT to be viewed as a cube)
+	bool generate_mips = false; //file asked for mip levels to be generated at load time (so data holds level 0 only)
+
+	//tightly packed texel data, as Helpers::transfer_to_image wants it: level by level (largest first), all layers of a level together
+	std::vector< uint8_t > data;
+
+	//read and validate a .ktx2 file: (throws on errors, unsupported features, and sizes that don't match the format)
+	static KTX2 load(std::string const &filename);
+
+	//create a device-local image and upload data to it, picking a format with Helpers::find_image_format:
+	// (if data must be decoded on the CPU, this replaces format and data; jobs run on workers, or on this thread if workers is null)
+	Helpers::AllocatedImage upload(Helpers &helpers, WorkerPool *workers = nullptr, Helpers::BindlessFlag bindless = Helpers::NotBindless);
+
+	//the format-picking part of upload, for callers that make the image themselves (e.g., Streamer):
+	// (leaves format and data ready to upload; only looks up format support, so it is safe to call from any thread)
+	void prepare(Helpers const &helpers, WorkerPool *workers = nullptr);
+	uint32_t image_mip_levels() const { return generate_mips ? Helpers::full_mip_levels(extent) : mip_levels; } //levels the image should have
+
+	//the uncompressed format that decode_bc() produces for a BCn format (or VK_FORMAT_UNDEFINED if there's no CPU decoder):
+	static VkFormat bc_fallback_format(VkFormat format);
+	//decode BCn data to bc_fallback_format(format), in place: (jobs run on workers, or on this thread if workers is null)
+	void decode_bc(WorkerPool *workers);
+};
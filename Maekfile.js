@@ -30,6 +30,11 @@ const main_objs = [
 	maek.CPP('Tutorial.cpp'),
 	maek.CPP('RTG.cpp'),
 	maek.CPP('Helpers.cpp'),
+	maek.CPP('KTX2.cpp'),
+	maek.CPP('Scene.cpp'),
+	maek.CPP('Streamer.cpp'),
+	maek.CPP('Profiler.cpp'),
+	maek.CPP('WorkerPool.cpp'),
 	maek.CPP('main.cpp'),
 ];
 
@@ -72,8 +77,11 @@ if (require('fs').existsSync('refsol.cpp')) {
 
 const main_exe = maek.LINK([...main_objs, ...prebuilt_objs], 'bin/main');
 
+//offline tool that converts .obj files to .scene files (see Scene.hpp):
+const convert_scene_exe = maek.LINK([maek.CPP('convert-scene.cpp')], 'bin/convert-scene');
+
 //default targets:
-maek.TARGETS = [main_exe];
+maek.TARGETS = [main_exe, convert_scene_exe];
 
 //- - - - - - - - - - - - - - - - - - - - -
 function custom_flags_and_rules() {
@@ -0,0 +1,77 @@
+#include "Profiler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+static uint64_t steady_ns() {
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+Profiler::Profiler() : slots(Capacity), epoch(steady_ns()) {
+	static_assert((Capacity & (Capacity - 1)) == 0, "Profiler::Capacity should be a power of two.");
+}
+
+uint64_t Profiler::now() const {
+	return steady_ns() - epoch;
+}
+
+void Profiler::record(char const *name, uint64_t begin, uint64_t end) {
+	uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+	Slot &slot = slots[index & (Capacity - 1)];
+
+	//mark the slot as being written, write it, then mark it complete:
+	slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.begin.store(begin, std::memory_order_relaxed);
+	slot.end.store(end, std::memory_order_relaxed);
+	slot.thread.store(thread_index(), std::memory_order_relaxed);
+	slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+uint32_t Profiler::thread_index() {
+	static std::atomic< uint32_t > next_index{0};
+	thread_local uint32_t index = next_index.fetch_add(1, std::memory_order_relaxed);
+	return index;
+}
+
+void Profiler::write_chrome_trace(std::string const &filename) const {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) throw std::runtime_error("Failed to open '" + filename + "' to write trace.");
+
+	uint64_t count = next.load(std::memory_order_acquire);
+	uint64_t first = (count > Capacity ? count - Capacity : 0);
+
+	//"X" (complete) events, with times in (fractional) microseconds:
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first_event = true;
+	for (uint64_t i = first; i < count; ++i) {
+		//read span i, skipping it if it is being written (or gets overwritten by a later span while being read):
+		Slot const &slot = slots[i & (Capacity - 1)];
+		uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence != 2 * i + 2) continue;
+		Span span;
+		span.name = slot.name.load(std::memory_order_relaxed);
+		span.begin = slot.begin.load(std::memory_order_relaxed);
+		span.end = slot.end.load(std::memory_order_relaxed);
+		span.thread = slot.thread.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+		char event[256];
+		std::snprintf(event, sizeof(event), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			(first_event ? "" : ",\n"),
+			(span.name ? span.name : "?"),
+			span.thread,
+			span.begin * 1e-3,
+			(span.end - span.begin) * 1e-3
+		);
+		out << event;
+		first_event = false;
+	}
+	out << "\n]}\n";
+
+	if (!out) throw std::runtime_error("Failed to write trace to '" + filename + "'.");
+}
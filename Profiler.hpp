@@ -0,0 +1,66 @@
+#pragma once
+
+//Lightweight CPU profiler: records named (begin, end) time spans into a fixed-size lock-free ring buffer.
+//Cheap enough (two clock reads and a few atomic operations per span) to leave on all the time.
+//
+//  Profiler profiler;
+//  {
+//    Profiler::Scope scope(profiler, "update"); //name must outlive the profiler (e.g., a string literal)
+//    ...
+//  }
+//  profiler.write_chrome_trace("trace.json"); //load in chrome://tracing or ui.perfetto.dev
+//
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Profiler {
+	struct Span {
+		char const *name = nullptr; //not copied; must be a string with static lifetime
+		uint64_t begin = 0, end = 0; //nanoseconds since the profiler was created
+		uint32_t thread = 0; //small per-thread index (see thread_index())
+	};
+
+	//a ring buffer slot: sequence is odd while a span is being written, and 2 * (span index + 1) once span index is complete,
+	// so readers can skip slots that are mid-write (or were overwritten while being read):
+	struct Slot {
+		std::atomic< uint64_t > sequence{0};
+		std::atomic< char const * > name{nullptr};
+		std::atomic< uint64_t > begin{0}, end{0};
+		std::atomic< uint32_t > thread{0};
+	};
+
+	static constexpr uint32_t Capacity = 1 << 16; //most recent spans kept (must be a power of two)
+
+	Profiler();
+	Profiler(Profiler const &) = delete;
+
+	//current time, in nanoseconds since the profiler was created:
+	uint64_t now() const;
+
+	//record a span (safe to call from any thread):
+	void record(char const *name, uint64_t begin, uint64_t end);
+
+	//records the span of its own lifetime:
+	struct Scope {
+		Scope(Profiler &profiler_, char const *name_) : profiler(profiler_), name(name_), begin(profiler_.now()) { }
+		~Scope() { profiler.record(name, begin, profiler.now()); }
+		Scope(Scope const &) = delete;
+		Profiler &profiler;
+		char const *name;
+		uint64_t begin;
+	};
+
+	//write recorded spans in Chrome's trace_event JSON format; throws on error.
+	// (safe while other threads are recording; spans still being written are left out)
+	void write_chrome_trace(std::string const &filename) const;
+
+	//internals:
+	std::vector< Slot > slots; //ring buffer of Capacity spans
+	std::atomic< uint64_t > next{0}; //total spans ever recorded; next slot is next % Capacity
+	uint64_t epoch; //steady_clock nanoseconds at creation
+
+	static uint32_t thread_index(); //0 for the first thread that records, 1 for the next, ...
+};
@@ -1,6 +1,7 @@
 #include "RTG.hpp"
 
 #include "VK.hpp"
+#include "WorkerPool.hpp"
 #include "refsol.hpp"
 
 #include <vulkan/vulkan_core.h>
@@ -11,11 +12,27 @@
 #include <vulkan/vk_enum_string_helper.h> //useful for debug output
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <set>
+#include <thread>
+
+//parse a count given as a command-line parameter: (throws if it isn't [0-9]+)
+static uint32_t parse_count(std::string const &flag, std::string const &val) {
+	if (val.empty() || val.find_first_not_of("0123456789") != std::string::npos) {
+		throw std::runtime_error(flag + " count should match [0-9]+, got '" + val + "'.");
+	}
+	return uint32_t(std::stoul(val));
+}
 
 void RTG::Configuration::parse(int argc, char **argv) {
 	for (int argi = 1; argi < argc; ++argi) {
@@ -42,6 +59,98 @@ void RTG::Configuration::parse(int argc, char **argv) {
 			};
 			surface_extent.width = conv("width");
 			surface_extent.height = conv("height");
+		} else if (arg == "--dynamic-rendering") {
+			dynamic_rendering = true;
+		} else if (arg == "--headless") {
+			headless = true;
+		} else if (arg == "--frames") {
+			if (argi + 1 >= argc) throw std::runtime_error("--frames requires a parameter (a frame count).");
+			argi += 1;
+			frames = parse_count(arg, argv[argi]);
+		} else if (arg == "--workspaces") {
+			if (argi + 1 >= argc) throw std::runtime_error("--workspaces requires a parameter (a workspace count).");
+			argi += 1;
+			workspaces = parse_count(arg, argv[argi]);
+			if (workspaces == 0) throw std::runtime_error("--workspaces count should be at least 1.");
+		} else if (arg == "--swapchain-images") {
+			if (argi + 1 >= argc) throw std::runtime_error("--swapchain-images requires a parameter (an image count).");
+			argi += 1;
+			swapchain_images = parse_count(arg, argv[argi]);
+		} else if (arg == "--present-mode") {
+			if (argi + 1 >= argc) throw std::runtime_error("--present-mode requires a parameter (fifo, mailbox, immediate, or fifo-relaxed).");
+			argi += 1;
+			std::string val = argv[argi];
+			VkPresentModeKHR mode = VK_PRESENT_MODE_FIFO_KHR;
+			if (val == "fifo") mode = VK_PRESENT_MODE_FIFO_KHR;
+			else if (val == "mailbox") mode = VK_PRESENT_MODE_MAILBOX_KHR;
+			else if (val == "immediate") mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+			else if (val == "fifo-relaxed") mode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+			else throw std::runtime_error("--present-mode should be fifo, mailbox, immediate, or fifo-relaxed, got '" + val + "'.");
+			present_modes.assign({mode});
+			if (mode != VK_PRESENT_MODE_FIFO_KHR) {
+				present_modes.emplace_back(VK_PRESENT_MODE_FIFO_KHR); //(always supported, so a safe fallback)
+			}
+		} else if (arg == "--profile") {
+			if (argi + 1 >= argc) throw std::runtime_error("--profile requires a parameter (low-latency, max-throughput, or default).");
+			argi += 1;
+			std::string val = argv[argi];
+			if (val == "low-latency") {
+				//one frame in flight and the fewest images, so input reaches the screen soon:
+				workspaces = 1;
+				swapchain_images = 1; //(raised to the surface's minimum)
+				present_modes.assign({VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR});
+			} else if (val == "max-throughput") {
+				//more frames in flight and more images, so neither the CPU nor the GPU waits; frame rate isn't tied to the display:
+				workspaces = 3;
+				swapchain_images = 4;
+				present_modes.assign({VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR});
+			} else if (val == "default") {
+				Configuration defaults;
+				workspaces = defaults.workspaces;
+				swapchain_images = defaults.swapchain_images;
+				present_modes = defaults.present_modes;
+			} else {
+				throw std::runtime_error("--profile should be low-latency, max-throughput, or default, got '" + val + "'.");
+			}
+		} else if (arg == "--recording-threads") {
+			if (argi + 1 >= argc) throw std::runtime_error("--recording-threads requires a parameter (a thread count).");
+			argi += 1;
+			recording_threads = parse_count(arg, argv[argi]);
+		} else if (arg == "--save-frames") {
+			if (argi + 1 >= argc) throw std::runtime_error("--save-frames requires a parameter (a file name prefix).");
+			argi += 1;
+			save_frames = argv[argi];
+		} else if (arg == "--pipeline-cache") {
+			if (argi + 1 >= argc) throw std::runtime_error("--pipeline-cache requires a parameter (a file name, or '' to disable).");
+			argi += 1;
+			pipeline_cache_file = argv[argi];
+		} else if (arg == "--memory-limit") {
+			if (argi + 1 >= argc) throw std::runtime_error("--memory-limit requires a parameter (a size in MiB, or 'budget').");
+			argi += 1;
+			std::string val = argv[argi];
+			if (val == "budget") {
+				memory_limit_budget = true;
+			} else {
+				memory_limit = VkDeviceSize(parse_count(arg, val)) * 1024 * 1024;
+			}
+		} else if (arg == "--memory-report") {
+			if (argi + 1 >= argc) throw std::runtime_error("--memory-report requires a parameter (a number of seconds).");
+			argi += 1;
+			memory_report_interval = parse_count(arg, argv[argi]);
+		} else if (arg == "--stream-budget") {
+			if (argi + 1 >= argc) throw std::runtime_error("--stream-budget requires a parameter (a size in KiB).");
+			argi += 1;
+			stream_budget = VkDeviceSize(parse_count(arg, argv[argi])) * 1024;
+			if (stream_budget == 0) throw std::runtime_error("--stream-budget must be at least 1 KiB.");
+		} else if (arg == "--stream-copies") {
+			if (argi + 1 >= argc) throw std::runtime_error("--stream-copies requires a parameter (a copy count).");
+			argi += 1;
+			stream_copies = parse_count(arg, argv[argi]);
+			if (stream_copies == 0) throw std::runtime_error("--stream-copies must be at least 1.");
+		} else if (arg == "--trace") {
+			if (argi + 1 >= argc) throw std::runtime_error("--trace requires a parameter (a file name).");
+			argi += 1;
+			trace_file = argv[argi];
 		} else {
 			throw std::runtime_error("Unrecognized argument '" + arg + "'.");
 		}
@@ -52,6 +161,41 @@ void RTG::Configuration::usage(std::function< void(const char *, const char *) >
 	callback("--debug, --no-debug", "Turn on/off debug and validation layers.");
 	callback("--physical-device <name>", "Run on the named physical device (guesses, otherwise).");
 	callback("--drawing-size <w> <h>", "Set the size of the surface to draw to.");
+	callback("--dynamic-rendering", "Draw with vkCmdBeginRendering instead of render pass and framebuffer objects.");
+	callback("--headless", "Don't create a window; render to offscreen images as fast as possible.");
+	callback("--workspaces <count>", "Allow <count> frames to be in flight at once (default 2).");
+	callback("--swapchain-images <count>", "Request <count> swapchain images (clamped to what the surface supports).");
+	callback("--present-mode <mode>", "Present with fifo, mailbox, immediate, or fifo-relaxed (falls back to fifo if unsupported).");
+	callback("--profile <name>", "Set workspaces, swapchain images, and present mode together: low-latency, max-throughput, or default.");
+	callback("--frames <count>", "Exit after rendering <count> frames (0 means run until closed).");
+	callback("--save-frames <prefix>", "Write every rendered frame to <prefix>NNNNNN.ppm (requires --headless).");
+	callback("--recording-threads <count>", "Record command buffers on up to <count> threads (0, the default, picks based on core count).");
+	callback("--memory-limit <MiB|budget>", "Fail device memory allocations that would put a heap over <MiB> (or over its VK_EXT_memory_budget budget).");
+	callback("--memory-report <seconds>", "Print device memory statistics every <seconds> while running.");
+	callback("--stream-budget <KiB>", "Upload at most <KiB> of streamed assets per frame (default 8192).");
+	callback("--stream-copies <count>", "Record at most <count> streamed-asset copy commands per frame (default 64).");
+	callback("--trace <file>", "On exit, write a Chrome trace (chrome://tracing, ui.perfetto.dev) of recent main loop phases to <file>.");
+	callback("--pipeline-cache <file>", "Load/save the pipeline cache from/to <file> ('' to disable; default pipeline-cache.bin).");
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+	VkDebugUtilsMessageTypeFlagsEXT type,
+	const VkDebugUtilsMessengerCallbackDataEXT *data,
+	void *user_data
+) {
+	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+		std::cerr << "\x1b[91m" << "E: ";
+	} else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+		std::cerr << "\x1b[33m" << "w: ";
+	} else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+		std::cerr << "\x1b[90m" << "i: ";
+	} else { //VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
+		std::cerr << "\x1b[90m" << "v: ";
+	}
+	std::cerr << data->pMessage << "\x1b[0m" << std::endl;
+
+	return VK_FALSE;
 }
 
 RTG::RTG(Configuration const &configuration_) : helpers(*this) {
@@ -61,23 +205,87 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 
 	//fill in flags/extensions/layers information:
 
-	//create the `instance` (main handle to Vulkan library):
-	refsol::RTG_constructor_create_instance(
-		configuration.application_info,
-		configuration.debug,
-		&instance,
-		&debug_messenger
-	);
+	{ //create the `instance` (main handle to Vulkan library):
+		VkInstanceCreateFlags instance_flags = 0;
+		std::vector< const char * > instance_extensions;
+		std::vector< const char * > instance_layers;
+
+		//add extensions for MoltenVK portability layer on macOS:
+		#if defined(__APPLE__)
+		instance_flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+
+		instance_extensions.emplace_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+		instance_extensions.emplace_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		if (!configuration.headless) {
+			instance_extensions.emplace_back(VK_EXT_METAL_SURFACE_EXTENSION_NAME);
+		}
+		#endif
+
+		//add extensions and layers for debugging:
+		if (configuration.debug) {
+			instance_extensions.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			instance_layers.emplace_back("VK_LAYER_KHRONOS_validation");
+		}
+
+		//add extensions needed by glfw: (headless mode doesn't touch glfw, so works without a display)
+		if (!configuration.headless) {
+			glfwInit();
+			if (!glfwVulkanSupported()) {
+				throw std::runtime_error("GLFW reports Vulkan is not supported.");
+			}
+
+			uint32_t count;
+			const char **extensions = glfwGetRequiredInstanceExtensions(&count);
+			if (extensions == nullptr) {
+				throw std::runtime_error("GLFW failed to return a list of requested instance extensions. Perhaps it was not compiled with Vulkan support.");
+			}
+			for (uint32_t i = 0; i < count; ++i) {
+				instance_extensions.emplace_back(extensions[i]);
+			}
+		}
+
+		//write debug messenger structure:
+		VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info{
+			.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+			.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+			.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+			.pfnUserCallback = debug_callback,
+			.pUserData = nullptr
+		};
+
+		VkInstanceCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+			.pNext = (configuration.debug ? &debug_messenger_create_info : nullptr), //pass debug structure if configured
+			.flags = instance_flags,
+			.pApplicationInfo = &configuration.application_info,
+			.enabledLayerCount = uint32_t(instance_layers.size()),
+			.ppEnabledLayerNames = instance_layers.data(),
+			.enabledExtensionCount = uint32_t(instance_extensions.size()),
+			.ppEnabledExtensionNames = instance_extensions.data()
+		};
+		VK( vkCreateInstance(&create_info, nullptr, &instance) );
+
+		//create debug messenger:
+		if (configuration.debug) {
+			PFN_vkCreateDebugUtilsMessengerEXT vkCreateDebugUtilsMessengerEXT = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+			if (!vkCreateDebugUtilsMessengerEXT) {
+				throw std::runtime_error("Failed to lookup debug utils create fn.");
+			}
+			VK( vkCreateDebugUtilsMessengerEXT(instance, &debug_messenger_create_info, nullptr, &debug_messenger) );
+		}
+	}
 
 	//create the `window` and `surface` (where things get drawn):
-	refsol::RTG_constructor_create_surface(
-		configuration.application_info,
-		configuration.debug,
-		configuration.surface_extent,
-		instance,
-		&window,
-		&surface
-	);
+	if (!configuration.headless) {
+		refsol::RTG_constructor_create_surface(
+			configuration.application_info,
+			configuration.debug,
+			configuration.surface_extent,
+			instance,
+			&window,
+			&surface
+		);
+	}
 
 	//select the `physical_device` -- the gpu that will be used to draw:
 	refsol::RTG_constructor_select_physical_device(
@@ -88,41 +296,357 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 	);
 
 	//select the `surface_format` and `present_mode` which control how colors are represented on the surface and how new images are supplied to the surface:
-	refsol::RTG_constructor_select_format_and_mode(
-		configuration.debug,
-		configuration.surface_formats,
-		configuration.present_modes,
-		physical_device,
-		surface,
-		&surface_format,
-		&present_mode
-	);
+	if (!configuration.headless) {
+		refsol::RTG_constructor_select_format_and_mode(
+			configuration.debug,
+			configuration.surface_formats,
+			configuration.present_modes,
+			physical_device,
+			surface,
+			&surface_format,
+			&present_mode
+		);
+	} else {
+		//in headless mode, use the first requested format that can be rendered to and copied from:
+		for (VkSurfaceFormatKHR const &format : configuration.surface_formats) {
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(physical_device, format.format, &properties);
+			VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT;
+			if ((properties.optimalTilingFeatures & needed) == needed) {
+				surface_format = format;
+				break;
+			}
+		}
+		if (surface_format.format == VK_FORMAT_UNDEFINED) {
+			throw std::runtime_error("No requested surface format is usable as an offscreen color attachment.");
+		}
+		//present mode has no meaning without a surface, but record the requested one for consistency:
+		if (!configuration.present_modes.empty()) present_mode = configuration.present_modes[0];
+	}
 
-	//create the `device` (logical interface to the GPU) and the `queue`s to which we can submit commands:
-	refsol::RTG_constructor_create_device(
-		configuration.debug,
-		physical_device,
-		surface,
-		&device,
-		&graphics_queue_family,
-		&graphics_queue,
-		&present_queue_family,
-		&present_queue
-	);
+	{ //create the `device` (logical interface to the GPU) and the `queue`s to which we can submit commands:
+		{ //look up queue indices:
+			uint32_t count = 0;
+			vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+			std::vector< VkQueueFamilyProperties > queue_families(count);
+			vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, queue_families.data());
+
+			for (auto const &queue_family : queue_families) {
+				uint32_t i = uint32_t(&queue_family - &queue_families[0]);
+
+				//if it does graphics, set the graphics queue family:
+				if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+					if (!graphics_queue_family) graphics_queue_family = i;
+				}
+
+				//if it does compute but not graphics, it can run alongside rendering:
+				if ((queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+					if (!compute_queue_family) compute_queue_family = i;
+				}
+
+				//if it does *only* transfers, it's probably a dedicated copy engine; use it for uploads:
+				if ((queue_family.queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == VK_QUEUE_TRANSFER_BIT) {
+					if (!transfer_queue_family) transfer_queue_family = i;
+				}
+
+				//if it has present support, set the present queue family:
+				if (surface != VK_NULL_HANDLE) {
+					VkBool32 present_support = VK_FALSE;
+					VK( vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &present_support) );
+					if (present_support == VK_TRUE) {
+						if (!present_queue_family) present_queue_family = i;
+					}
+				}
+			}
+
+			if (!graphics_queue_family) {
+				throw std::runtime_error("No queue with graphics support.");
+			}
+
+			if (!configuration.headless && !present_queue_family) {
+				throw std::runtime_error("No queue with present support.");
+			}
+
+			//no dedicated transfer family? (e.g., lavapipe) graphics queues can always do transfers:
+			if (!transfer_queue_family) {
+				transfer_queue_family = graphics_queue_family;
+			}
+
+			//no async compute family? graphics queues can always do compute:
+			if (!compute_queue_family) {
+				compute_queue_family = graphics_queue_family;
+			}
+
+			if (configuration.debug) {
+				std::cout << "Queue families: graphics " << graphics_queue_family.value()
+				          << ", transfer " << transfer_queue_family.value()
+				          << (transfer_queue_family == graphics_queue_family ? " (shared with graphics)" : " (dedicated)")
+				          << ", compute " << compute_queue_family.value()
+				          << (compute_queue_family == graphics_queue_family ? " (shared with graphics)" : " (async)")
+				          << ", present " << (present_queue_family ? std::to_string(present_queue_family.value()) : std::string("none")) << "." << std::endl;
+			}
+		}
+
+		//check which device extensions are available:
+		std::set< std::string > available_extensions;
+		{
+			uint32_t count = 0;
+			VK( vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr) );
+			std::vector< VkExtensionProperties > extensions(count);
+			VK( vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, extensions.data()) );
+			for (VkExtensionProperties const &extension : extensions) {
+				available_extensions.emplace(extension.extensionName);
+			}
+		}
+
+		//select device extensions:
+		std::vector< const char * > device_extensions;
+		#if defined(__APPLE__)
+		device_extensions.emplace_back(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME);
+		#endif
+		//Add the swapchain extension:
+		// (in headless mode it is optional, but applications' render passes may still use VK_IMAGE_LAYOUT_PRESENT_SRC_KHR)
+		if (!configuration.headless || available_extensions.count(VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+			device_extensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
+		//per-heap budget and usage, for Helpers' memory statistics and soft limit:
+		if (available_extensions.count(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+			device_extensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			memory_budget_supported = true;
+		} else if (configuration.memory_limit_budget) {
+			std::cerr << "WARNING: --memory-limit budget needs " << VK_EXT_MEMORY_BUDGET_EXTENSION_NAME << ", which this device doesn't support; only heap sizes will limit allocations." << std::endl;
+		}
+
+		//query supported features, so optional ones are only enabled when present:
+		VkPhysicalDeviceVulkan13Features supported_features_13{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+		};
+		VkPhysicalDeviceVulkan12Features supported_features_12{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+			.pNext = &supported_features_13,
+		};
+		VkPhysicalDeviceFeatures2 supported_features{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+			.pNext = &supported_features_12,
+		};
+		vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
+
+		//select device features:
+		enabled_features_12.hostQueryReset = supported_features_12.hostQueryReset; //for GPUTimer
+
+		if (!supported_features_12.timelineSemaphore) {
+			throw std::runtime_error("Device does not support timeline semaphores (used for frame pacing).");
+		}
+		enabled_features_12.timelineSemaphore = VK_TRUE;
+
+		//for Helpers' bindless descriptor heap (optional; the heap is skipped if anything is missing):
+		if (supported_features_12.descriptorIndexing
+		 && supported_features_12.runtimeDescriptorArray
+		 && supported_features_12.descriptorBindingPartiallyBound
+		 && supported_features_12.descriptorBindingVariableDescriptorCount
+		 && supported_features_12.descriptorBindingUpdateUnusedWhilePending
+		 && supported_features_12.descriptorBindingSampledImageUpdateAfterBind
+		 && supported_features_12.descriptorBindingStorageBufferUpdateAfterBind
+		 && supported_features_12.shaderSampledImageArrayNonUniformIndexing
+		 && supported_features_12.shaderStorageBufferArrayNonUniformIndexing) {
+			enabled_features_12.descriptorIndexing = VK_TRUE;
+			enabled_features_12.runtimeDescriptorArray = VK_TRUE;
+			enabled_features_12.descriptorBindingPartiallyBound = VK_TRUE;
+			enabled_features_12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+			enabled_features_12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			enabled_features_12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			enabled_features_12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+			enabled_features_12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			enabled_features_12.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+		}
+
+		if (configuration.dynamic_rendering) {
+			if (!supported_features_13.dynamicRendering) {
+				throw std::runtime_error("Device does not support dynamic rendering (requested with --dynamic-rendering).");
+			}
+			enabled_features_13.dynamicRendering = VK_TRUE;
+		}
+
+		{ //create the logical device:
+			enabled_features_12.pNext = &enabled_features_13;
+
+			std::vector< VkDeviceQueueCreateInfo > queue_create_infos;
+			std::set< uint32_t > unique_queue_families{
+				graphics_queue_family.value(),
+				transfer_queue_family.value(),
+				compute_queue_family.value(),
+			};
+			if (present_queue_family) unique_queue_families.emplace(present_queue_family.value());
+
+			float queue_priorities[1] = { 1.0f };
+			for (uint32_t queue_family : unique_queue_families) {
+				queue_create_infos.emplace_back(VkDeviceQueueCreateInfo{
+					.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+					.queueFamilyIndex = queue_family,
+					.queueCount = 1,
+					.pQueuePriorities = queue_priorities,
+				});
+			}
+
+			VkDeviceCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+				.pNext = &enabled_features_12, //feature structures chain from here (12 -> 13)
+				.queueCreateInfoCount = uint32_t(queue_create_infos.size()),
+				.pQueueCreateInfos = queue_create_infos.data(),
+
+				//device layers are depreciated; spec suggests passing instance_layers or nullptr:
+				.enabledLayerCount = 0,
+				.ppEnabledLayerNames = nullptr,
+
+				.enabledExtensionCount = static_cast< uint32_t>(device_extensions.size()),
+				.ppEnabledExtensionNames = device_extensions.data(),
+
+				//pass a pointer to a VkPhysicalDeviceFeatures to request specific features: (e.g., thick lines)
+				.pEnabledFeatures = nullptr,
+			};
+
+			VK( vkCreateDevice(physical_device, &create_info, nullptr, &device) );
+
+			vkGetDeviceQueue(device, graphics_queue_family.value(), 0, &graphics_queue);
+			vkGetDeviceQueue(device, transfer_queue_family.value(), 0, &transfer_queue);
+			vkGetDeviceQueue(device, compute_queue_family.value(), 0, &compute_queue);
+			if (present_queue_family) {
+				vkGetDeviceQueue(device, present_queue_family.value(), 0, &present_queue);
+			}
+
+			enabled_features_12.pNext = nullptr; //(these are only chained while creating the device)
+		}
+	}
+
+	{ //check support for GPU timing:
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+		uint32_t count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+		std::vector< VkQueueFamilyProperties > queue_families(count);
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, queue_families.data());
+		uint32_t valid_bits = queue_families[graphics_queue_family.value()].timestampValidBits;
+
+		gpu_timers_supported = (enabled_features_12.hostQueryReset == VK_TRUE && valid_bits != 0);
+		timestamp_period = properties.limits.timestampPeriod;
+		timestamp_mask = (valid_bits >= 64 ? ~0ULL : (1ULL << valid_bits) - 1);
+
+		if (configuration.debug && !gpu_timers_supported) {
+			std::cout << "GPU timing is not supported on this device; GPUTimer regions will not be measured." << std::endl;
+		}
+	}
+
+	//load cached pipelines from previous runs (if any):
+	create_pipeline_cache();
 
 	//run any resource creation required by Helpers structure:
 	helpers.create();
 
+	//set up frame saving:
+	if (!configuration.save_frames.empty()) {
+		if (!configuration.headless) {
+			throw std::runtime_error("--save-frames is only supported in --headless mode.");
+		}
+		switch (surface_format.format) {
+			case VK_FORMAT_B8G8R8A8_SRGB:
+			case VK_FORMAT_B8G8R8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+			case VK_FORMAT_R8G8B8A8_UNORM:
+				break;
+			default:
+				throw std::runtime_error("Don't know how to save frames with format " + std::string(string_VkFormat(surface_format.format)) + ".");
+		}
+
+		VkCommandPoolCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = 0, //copy commands are recorded once and re-submitted every frame
+			.queueFamilyIndex = graphics_queue_family.value(),
+		};
+		VK( vkCreateCommandPool(device, &create_info, nullptr, &headless_command_pool) );
+
+		//writing is mostly disk-bound, so a few threads is plenty:
+		frame_writers = std::make_unique< WorkerPool >(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+	}
+
 	//create initial swapchain:
 	recreate_swapchain();
 
+	//threads for record_parallel:
+	recording_threads = configuration.recording_threads;
+	if (recording_threads == 0) {
+		recording_threads = std::clamp(std::thread::hardware_concurrency(), 1u, 16u);
+	}
+	if (recording_threads > 1) {
+		recorders = std::make_unique< WorkerPool >(recording_threads - 1);
+	}
+
+	{ //create timeline semaphores for frame pacing:
+		VkSemaphoreTypeCreateInfo type_info{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = 0, //"frame 0" is done before anything starts
+		};
+		VkSemaphoreCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &type_info,
+		};
+		VK( vkCreateSemaphore(device, &create_info, nullptr, &frame_timeline) );
+		VK( vkCreateSemaphore(device, &create_info, nullptr, &compute_timeline) );
+		if (configuration.headless) {
+			VK( vkCreateSemaphore(device, &create_info, nullptr, &headless_timeline) );
+		}
+	}
+
 	//create workspace resources:
 	workspaces.resize(configuration.workspaces);
 	for (auto &workspace : workspaces) {
-		refsol::RTG_constructor_per_workspace(device, &workspace);
+		VkSemaphoreCreateInfo semaphore_info{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		};
+		VK( vkCreateSemaphore(device, &semaphore_info, nullptr, &workspace.image_available) );
+
+		VkCommandPoolCreateInfo pool_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, //re-recorded every frame
+			.queueFamilyIndex = compute_queue_family.value(),
+		};
+		VK( vkCreateCommandPool(device, &pool_info, nullptr, &workspace.compute_command_pool) );
+
+		VkCommandBufferAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = workspace.compute_command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VK( vkAllocateCommandBuffers(device, &alloc_info, &workspace.compute_command_buffer) );
+
+		if (gpu_timers_supported) {
+			VkQueryPoolCreateInfo query_pool_info{
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_TIMESTAMP,
+				.queryCount = 2 * GPUTimerRegions,
+			};
+			VK( vkCreateQueryPool(device, &query_pool_info, nullptr, &workspace.timestamp_queries) );
+			vkResetQueryPool(device, workspace.timestamp_queries, 0, 2 * GPUTimerRegions);
+		}
+
+		workspace.recording_slots.resize(recording_threads);
+		for (auto &slot : workspace.recording_slots) {
+			VkCommandPoolCreateInfo slot_pool_info{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, //re-recorded every frame
+				.queueFamilyIndex = graphics_queue_family.value(),
+			};
+			VK( vkCreateCommandPool(device, &slot_pool_info, nullptr, &slot.command_pool) );
+		}
 	}
 
+	//report what was actually chosen, since the surface may not support what was requested:
+	std::cout << "Using " << workspaces.size() << " workspaces, " << swapchain_images.size() << " swapchain images, and "
+	          << (configuration.headless ? "no presentation (headless)" : "present mode " + std::string(string_VkPresentModeKHR(present_mode))) << "." << std::endl;
 }
+
 RTG::~RTG() {
 	//don't destroy until device is idle:
 	if (device != VK_NULL_HANDLE) {
@@ -131,53 +655,1154 @@ RTG::~RTG() {
 		}
 	}
 
+	//stop recording threads: (they are idle outside of record_parallel)
+	recorders.reset();
+
 	//destroy workspace resources:
 	for (auto &workspace : workspaces) {
-		refsol::RTG_destructor_per_workspace(device, &workspace);
+		for (auto &slot : workspace.recording_slots) {
+			//(frees slot.command_buffers as well)
+			vkDestroyCommandPool(device, slot.command_pool, nullptr);
+		}
+		workspace.recording_slots.clear();
+
+		if (workspace.timestamp_queries != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, workspace.timestamp_queries, nullptr);
+			workspace.timestamp_queries = VK_NULL_HANDLE;
+		}
+		if (workspace.compute_command_pool != VK_NULL_HANDLE) {
+			//(frees compute_command_buffer as well)
+			vkDestroyCommandPool(device, workspace.compute_command_pool, nullptr);
+			workspace.compute_command_pool = VK_NULL_HANDLE;
+			workspace.compute_command_buffer = VK_NULL_HANDLE;
+		}
+
+		if (workspace.image_available != VK_NULL_HANDLE) {
+			vkDestroySemaphore(device, workspace.image_available, nullptr);
+			workspace.image_available = VK_NULL_HANDLE;
+		}
 	}
 	workspaces.clear();
 
-	//destroy the swapchain:
+	for (VkSemaphore *timeline : {&frame_timeline, &compute_timeline, &headless_timeline}) {
+		if (*timeline != VK_NULL_HANDLE) {
+			vkDestroySemaphore(device, *timeline, nullptr);
+			*timeline = VK_NULL_HANDLE;
+		}
+	}
+
+	//finish writing any saved frames:
+	if (frame_writers) {
+		frame_writers->wait_idle();
+	}
+
+	//destroy the swapchain: (swapchains it replaced are in the helpers deletion queue)
 	destroy_swapchain();
 
+	if (headless_command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(device, headless_command_pool, nullptr);
+		headless_command_pool = VK_NULL_HANDLE;
+	}
+
+	frame_writers.reset();
+
 	//destroy Helpers structure resources:
 	helpers.destroy();
 
+	//save cached pipelines for the next run:
+	destroy_pipeline_cache();
+
 	//destroy the rest of the resources:
-	refsol::RTG_destructor( &device, &surface, &window, &debug_messenger, &instance );
+	if (device != VK_NULL_HANDLE) {
+		vkDestroyDevice(device, nullptr);
+		device = VK_NULL_HANDLE;
+	}
+
+	if (surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(instance, surface, nullptr);
+		surface = VK_NULL_HANDLE;
+	}
 
+	if (window != nullptr) {
+		glfwDestroyWindow(window);
+		window = nullptr;
+	}
+
+	if (debug_messenger != VK_NULL_HANDLE) {
+		PFN_vkDestroyDebugUtilsMessengerEXT vkDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+		if (vkDestroyDebugUtilsMessengerEXT) {
+			vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, nullptr);
+			debug_messenger = VK_NULL_HANDLE;
+		}
+	}
+
+	if (instance != VK_NULL_HANDLE) {
+		vkDestroyInstance(instance, nullptr);
+		instance = VK_NULL_HANDLE;
+	}
+
+	if (!configuration.headless) {
+		glfwTerminate();
+	}
+}
+
+
+//Pipeline cache files are this header followed by the data from vkGetPipelineCacheData:
+struct PipelineCacheFileHeader {
+	char magic[8]; //"nakluVpc"
+	uint32_t version; //file layout version; bump when this structure changes
+	uint32_t vendor_id, device_id, driver_version; //from VkPhysicalDeviceProperties; any change invalidates the cache
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+	uint64_t data_size; //bytes of cache data following the header
+	uint64_t data_hash; //FNV-1a hash of the cache data, to catch truncated/corrupt files
+};
+static constexpr char PipelineCacheMagic[8] = {'n','a','k','l','u','V','p','c'};
+static constexpr uint32_t PipelineCacheVersion = 1;
+
+static uint64_t fnv1a(std::vector< char > const &data, size_t begin) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = begin; i < data.size(); ++i) {
+		hash = (hash ^ uint8_t(data[i])) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+void RTG::create_pipeline_cache() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	//read and validate the saved cache:
+	std::vector< char > file;
+	if (!configuration.pipeline_cache_file.empty()) {
+		std::ifstream in(configuration.pipeline_cache_file, std::ios::binary);
+		if (in) {
+			file.assign(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+		}
+	}
+
+	std::string problem = "";
+	if (file.empty()) {
+		problem = "no saved cache";
+	} else if (file.size() < sizeof(PipelineCacheFileHeader)) {
+		problem = "file too small";
+	} else {
+		PipelineCacheFileHeader header;
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, PipelineCacheMagic, sizeof(header.magic)) != 0 || header.version != PipelineCacheVersion) {
+			problem = "not a (current) pipeline cache file";
+		} else if (header.vendor_id != properties.vendorID || header.device_id != properties.deviceID || header.driver_version != properties.driverVersion
+		        || std::memcmp(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			problem = "saved for a different device or driver";
+		} else if (header.data_size != file.size() - sizeof(header) || header.data_hash != fnv1a(file, sizeof(header))) {
+			problem = "truncated or corrupt";
+		} else {
+			//also check the header Vulkan itself puts at the start of the data:
+			VkPipelineCacheHeaderVersionOne vk_header;
+			if (header.data_size < sizeof(vk_header)) {
+				problem = "cache data too small";
+			} else {
+				std::memcpy(&vk_header, file.data() + sizeof(header), sizeof(vk_header));
+				if (vk_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+				 || vk_header.vendorID != properties.vendorID || vk_header.deviceID != properties.deviceID
+				 || std::memcmp(vk_header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+					problem = "cache data header doesn't match device";
+				}
+			}
+		}
+	}
+
+	size_t offset = sizeof(PipelineCacheFileHeader);
+	if (!problem.empty()) {
+		if (configuration.debug && !configuration.pipeline_cache_file.empty()) {
+			std::cout << "Starting with an empty pipeline cache (" << problem << ": '" << configuration.pipeline_cache_file << "')." << std::endl;
+		}
+		file.clear();
+		offset = 0;
+	} else if (configuration.debug) {
+		std::cout << "Loaded " << (file.size() - offset) << " bytes of pipeline cache from '" << configuration.pipeline_cache_file << "'." << std::endl;
+	}
+
+	VkPipelineCacheCreateInfo create_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = file.size() - offset,
+		.pInitialData = (file.empty() ? nullptr : file.data() + offset),
+	};
+	VK( vkCreatePipelineCache(device, &create_info, nullptr, &pipeline_cache) );
 }
 
+void RTG::destroy_pipeline_cache() {
+	if (pipeline_cache == VK_NULL_HANDLE) return;
+
+	//(not throwing from here, since this is called from the destructor)
+	if (!configuration.pipeline_cache_file.empty()) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+		std::vector< char > file(sizeof(PipelineCacheFileHeader));
+		size_t data_size = 0;
+		VkResult result = vkGetPipelineCacheData(device, pipeline_cache, &data_size, nullptr);
+		if (result == VK_SUCCESS) {
+			file.resize(sizeof(PipelineCacheFileHeader) + data_size);
+			result = vkGetPipelineCacheData(device, pipeline_cache, &data_size, file.data() + sizeof(PipelineCacheFileHeader));
+			file.resize(sizeof(PipelineCacheFileHeader) + data_size);
+		}
+
+		if (result != VK_SUCCESS) {
+			std::cerr << "Failed to get pipeline cache data [" << string_VkResult(result) << "]; not saving it." << std::endl;
+		} else {
+			PipelineCacheFileHeader header;
+			std::memcpy(header.magic, PipelineCacheMagic, sizeof(header.magic));
+			header.version = PipelineCacheVersion;
+			header.vendor_id = properties.vendorID;
+			header.device_id = properties.deviceID;
+			header.driver_version = properties.driverVersion;
+			std::memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+			header.data_size = data_size;
+			header.data_hash = fnv1a(file, sizeof(header));
+			std::memcpy(file.data(), &header, sizeof(header));
+
+			//write to a temporary file and rename it over the old one, so a crash never leaves a half-written cache:
+			std::string temp = configuration.pipeline_cache_file + ".tmp";
+			bool written = false;
+			{
+				std::ofstream out(temp, std::ios::binary);
+				out.write(file.data(), file.size());
+				written = bool(out);
+			}
+			std::error_code error;
+			if (written) {
+				std::filesystem::rename(temp, configuration.pipeline_cache_file, error);
+			}
+			if (!written || error) {
+				std::cerr << "Failed to save pipeline cache to '" << configuration.pipeline_cache_file << "'" << (error ? " (" + error.message() + ")" : std::string("")) << "." << std::endl;
+				std::filesystem::remove(temp, error);
+			} else if (configuration.debug) {
+				std::cout << "Saved " << data_size << " bytes of pipeline cache to '" << configuration.pipeline_cache_file << "'." << std::endl;
+			}
+		}
+	}
+
+	vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+	pipeline_cache = VK_NULL_HANDLE;
+}
 
 void RTG::recreate_swapchain() {
-	refsol::RTG_recreate_swapchain(
-		configuration.debug,
-		device,
-		physical_device,
-		surface,
-		surface_format,
-		present_mode,
-		graphics_queue_family,
-		present_queue_family,
-		&swapchain,
-		&swapchain_extent,
-		&swapchain_images,
-		&swapchain_image_views,
-		&swapchain_image_dones
-	);
+	if (configuration.headless) {
+		//clean up any existing offscreen images:
+		if (!headless_swapchain.empty()) {
+			destroy_swapchain();
+		}
+
+		swapchain_extent = configuration.surface_extent;
+
+		//by default, one more image than workspaces, so acquiring an image never waits on a workspace that is still free:
+		uint32_t image_count = (configuration.swapchain_images != 0 ? configuration.swapchain_images : configuration.workspaces + 1);
+
+		headless_swapchain.resize(image_count);
+		for (HeadlessSwapchainImage &headless : headless_swapchain) {
+			headless.image = helpers.create_image(
+				swapchain_extent,
+				surface_format.format,
+				VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+			);
+
+			swapchain_images.emplace_back(headless.image.handle);
+
+			if (!configuration.save_frames.empty()) {
+				VkImage image = headless.image.handle;
+
+				for (HeadlessSwapchainImage::Readback &readback : headless.readbacks) {
+					readback.buffer = helpers.create_buffer(
+						VkDeviceSize(swapchain_extent.width) * swapchain_extent.height * 4,
+						VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						Helpers::Mapped
+					);
+
+					VkCommandBufferAllocateInfo alloc_info{
+						.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+						.commandPool = headless_command_pool,
+						.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+						.commandBufferCount = 1,
+					};
+					VK( vkAllocateCommandBuffers(device, &alloc_info, &readback.copy_command) );
+
+					//record the copy once; it is the same every frame:
+					VkCommandBufferBeginInfo begin_info{
+						.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+						.flags = 0,
+					};
+					VK( vkBeginCommandBuffer(readback.copy_command, &begin_info) );
+
+					VkImageSubresourceRange whole_image{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1,
+					};
+
+					//applications leave the image ready to present, as they would with a real swapchain:
+					VkImageMemoryBarrier to_transfer{
+						.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+						.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+						.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+						.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+						.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.image = image,
+						.subresourceRange = whole_image,
+					};
+					vkCmdPipelineBarrier(readback.copy_command,
+						VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+						0, nullptr,
+						0, nullptr,
+						1, &to_transfer
+					);
+
+					VkBufferImageCopy region{
+						.bufferOffset = 0,
+						.bufferRowLength = 0, //tightly packed
+						.bufferImageHeight = 0,
+						.imageSubresource{
+							.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+							.mipLevel = 0,
+							.baseArrayLayer = 0,
+							.layerCount = 1,
+						},
+						.imageOffset{ .x = 0, .y = 0, .z = 0 },
+						.imageExtent{ .width = swapchain_extent.width, .height = swapchain_extent.height, .depth = 1 },
+					};
+					vkCmdCopyImageToBuffer(readback.copy_command, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer.handle, 1, &region);
+
+					//make the copy visible to the host:
+					VkBufferMemoryBarrier to_host{
+						.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+						.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+						.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+						.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.buffer = readback.buffer.handle,
+						.offset = 0,
+						.size = VK_WHOLE_SIZE,
+					};
+					//and put the image back the way the application left it:
+					VkImageMemoryBarrier to_present{
+						.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+						.srcAccessMask = 0,
+						.dstAccessMask = 0,
+						.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+						.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+						.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.image = image,
+						.subresourceRange = whole_image,
+					};
+					vkCmdPipelineBarrier(readback.copy_command,
+						VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+						0, nullptr,
+						1, &to_host,
+						1, &to_present
+					);
+
+					VK( vkEndCommandBuffer(readback.copy_command) );
+				}
+			}
+		}
+
+		next_headless_image = 0;
+	} else {
+		//retire (rather than destroy) the existing swapchain, if any:
+		// it is handed to the new swapchain as oldSwapchain, frames still in flight may be using its images,
+		// and pending presents may still be waiting on its image_done semaphores
+		VkSwapchainKHR old_swapchain = swapchain;
+		if (old_swapchain != VK_NULL_HANDLE) {
+			retired_swapchains.emplace_back([device=device, old_swapchain, image_views=swapchain_image_views, image_dones=swapchain_image_dones]() {
+				for (VkSemaphore semaphore : image_dones) {
+					vkDestroySemaphore(device, semaphore, nullptr);
+				}
+				for (VkImageView image_view : image_views) {
+					vkDestroyImageView(device, image_view, nullptr);
+				}
+				vkDestroySwapchainKHR(device, old_swapchain, nullptr);
+			});
+			swapchain = VK_NULL_HANDLE;
+			swapchain_images.clear();
+			swapchain_image_views.clear();
+			swapchain_image_dones.clear();
+		}
+
+		VkSurfaceCapabilitiesKHR capabilities;
+		VK( vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &capabilities) );
+
+		//the surface decides the extent, unless it reports the special "up to the swapchain" value:
+		if (capabilities.currentExtent.width != 0xFFFFFFFF) {
+			swapchain_extent = capabilities.currentExtent;
+		} else {
+			int width = 0, height = 0;
+			glfwGetFramebufferSize(window, &width, &height);
+			swapchain_extent = VkExtent2D{
+				.width = std::clamp(uint32_t(width), capabilities.minImageExtent.width, capabilities.maxImageExtent.width),
+				.height = std::clamp(uint32_t(height), capabilities.minImageExtent.height, capabilities.maxImageExtent.height),
+			};
+		}
+
+		//by default, one more image than the minimum, so the application isn't waiting on the presentation engine:
+		uint32_t image_count = (configuration.swapchain_images != 0 ? configuration.swapchain_images : capabilities.minImageCount + 1);
+		image_count = std::max(image_count, capabilities.minImageCount);
+		if (capabilities.maxImageCount != 0) { //(0 means "no maximum")
+			image_count = std::min(image_count, capabilities.maxImageCount);
+		}
+
+		std::array< uint32_t, 2 > queue_family_indices{
+			graphics_queue_family.value(),
+			present_queue_family.value(),
+		};
+
+		VkSwapchainCreateInfoKHR create_info{
+			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+			.surface = surface,
+			.minImageCount = image_count,
+			.imageFormat = surface_format.format,
+			.imageColorSpace = surface_format.colorSpace,
+			.imageExtent = swapchain_extent,
+			.imageArrayLayers = 1,
+			.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+			.preTransform = capabilities.currentTransform,
+			.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+			.presentMode = present_mode,
+			.clipped = VK_TRUE,
+			.oldSwapchain = old_swapchain, //lets the presentation engine reuse resources
+		};
+
+		//images are shared if graphics and present are different families:
+		if (queue_family_indices[0] != queue_family_indices[1]) {
+			create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+			create_info.queueFamilyIndexCount = uint32_t(queue_family_indices.size());
+			create_info.pQueueFamilyIndices = queue_family_indices.data();
+		}
+
+		VK( vkCreateSwapchainKHR(device, &create_info, nullptr, &swapchain) );
+
+		//get the swapchain images: (there may be more than requested)
+		uint32_t count = 0;
+		VK( vkGetSwapchainImagesKHR(device, swapchain, &count, nullptr) );
+		swapchain_images.assign(count, VK_NULL_HANDLE);
+		VK( vkGetSwapchainImagesKHR(device, swapchain, &count, swapchain_images.data()) );
+	}
+
+	//create views for the images:
+	swapchain_image_views.assign(swapchain_images.size(), VK_NULL_HANDLE);
+	for (size_t i = 0; i < swapchain_images.size(); ++i) {
+		VkImageViewCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = swapchain_images[i],
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = surface_format.format,
+			.components{
+				.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+				.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+				.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+				.a = VK_COMPONENT_SWIZZLE_IDENTITY
+			},
+			.subresourceRange{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+		};
+		VK( vkCreateImageView(device, &create_info, nullptr, &swapchain_image_views[i]) );
+	}
+
+	//create semaphores signal'd when rendering to each image is done:
+	swapchain_image_dones.assign(swapchain_images.size(), VK_NULL_HANDLE);
+	for (size_t i = 0; i < swapchain_images.size(); ++i) {
+		VkSemaphoreCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		};
+		VK( vkCreateSemaphore(device, &create_info, nullptr, &swapchain_image_dones[i]) );
+	}
+
+	if (configuration.debug) {
+		std::cout << (configuration.headless ? "Headless swapchain is " : "Swapchain is ") << swapchain_images.size() << " images of size " << swapchain_extent.width << "x" << swapchain_extent.height << "." << std::endl;
+	}
 }
 
 
 void RTG::destroy_swapchain() {
-	refsol::RTG_destroy_swapchain(
-		device,
-		&swapchain,
-		&swapchain_images,
-		&swapchain_image_views,
-		&swapchain_image_dones
-	);
+	//images may still be in use by rendering or presentation:
+	//(not using VK macro because this is also called from the destructor)
+	if (VkResult result = vkDeviceWaitIdle(device); result != VK_SUCCESS) {
+		std::cerr << "Failed to vkDeviceWaitIdle in RTG::destroy_swapchain [" << string_VkResult(result) << "]; continuing anyway." << std::endl;
+	}
+
+	//(nothing is presenting anymore, so replaced swapchains can go now, too)
+	for (auto const &destroy : retired_swapchains) {
+		destroy();
+	}
+	retired_swapchains.clear();
+
+	for (VkSemaphore &semaphore : swapchain_image_dones) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+		semaphore = VK_NULL_HANDLE;
+	}
+	swapchain_image_dones.clear();
+
+	for (VkImageView &image_view : swapchain_image_views) {
+		vkDestroyImageView(device, image_view, nullptr);
+		image_view = VK_NULL_HANDLE;
+	}
+	swapchain_image_views.clear();
+
+	swapchain_images.clear(); //owned by swapchain or headless_swapchain
+
+	if (configuration.headless) {
+		for (HeadlessSwapchainImage &headless : headless_swapchain) {
+			for (HeadlessSwapchainImage::Readback &readback : headless.readbacks) {
+				//don't free a buffer that a writer is still reading:
+				if (readback.buffer_released.valid()) {
+					readback.buffer_released.wait();
+				}
+				if (readback.copy_command != VK_NULL_HANDLE) {
+					vkFreeCommandBuffers(device, headless_command_pool, 1, &readback.copy_command);
+					readback.copy_command = VK_NULL_HANDLE;
+				}
+				if (readback.buffer.handle != VK_NULL_HANDLE) {
+					helpers.destroy_buffer(std::move(readback.buffer));
+				}
+			}
+			headless.readback = 0;
+			headless.presented_frame = 0;
+			helpers.destroy_image(std::move(headless.image));
+		}
+		headless_swapchain.clear();
+	} else {
+		vkDestroySwapchainKHR(device, swapchain, nullptr);
+		swapchain = VK_NULL_HANDLE;
+	}
 }
 
 void RTG::run(Application &application) {
-	refsol::RTG_run(*this, application);
+	//initial on_swapchain:
+	auto on_swapchain = [&,this]() {
+		application.on_swapchain(*this, SwapchainEvent{
+			.extent = swapchain_extent,
+			.images = swapchain_images,
+			.image_views = swapchain_image_views,
+		});
+	};
+	on_swapchain();
+
+	//setup event handling: (no events in headless mode)
+	std::vector< InputEvent > event_queue;
+	if (window) {
+		glfwSetWindowUserPointer(window, &event_queue);
+
+		glfwSetCursorPosCallback(window, [](GLFWwindow *window, double xpos, double ypos) {
+			std::vector< InputEvent > *event_queue = reinterpret_cast< std::vector< InputEvent > * >(glfwGetWindowUserPointer(window));
+			if (!event_queue) return;
+
+			InputEvent event;
+			std::memset(&event, '\0', sizeof(event));
+
+			event.type = InputEvent::MouseMotion;
+			event.motion.x = float(xpos);
+			event.motion.y = float(ypos);
+			event.motion.state = 0;
+			for (int b = 0; b < 8 && b < GLFW_MOUSE_BUTTON_LAST; ++b) {
+				if (glfwGetMouseButton(window, b) == GLFW_PRESS) {
+					event.motion.state |= (1 << b);
+				}
+			}
+
+			event_queue->emplace_back(event);
+		});
+
+		glfwSetMouseButtonCallback(window, [](GLFWwindow *window, int button, int action, int mods) {
+			std::vector< InputEvent > *event_queue = reinterpret_cast< std::vector< InputEvent > * >(glfwGetWindowUserPointer(window));
+			if (!event_queue) return;
+
+			double xpos, ypos;
+			glfwGetCursorPos(window, &xpos, &ypos);
+
+			InputEvent event;
+			std::memset(&event, '\0', sizeof(event));
+
+			if (action == GLFW_PRESS) {
+				event.type = InputEvent::MouseButtonDown;
+			} else if (action == GLFW_RELEASE) {
+				event.type = InputEvent::MouseButtonUp;
+			} else {
+				std::cerr << "Strange: unknown mouse button action." << std::endl;
+				return;
+			}
+
+			event.button.x = float(xpos);
+			event.button.y = float(ypos);
+			event.button.state = 0;
+			for (int b = 0; b < 8 && b < GLFW_MOUSE_BUTTON_LAST; ++b) {
+				if (glfwGetMouseButton(window, b) == GLFW_PRESS) {
+					event.button.state |= (1 << b);
+				}
+			}
+			event.button.button = uint8_t(button);
+			event.button.mods = uint8_t(mods);
+
+			event_queue->emplace_back(event);
+		});
+
+		glfwSetScrollCallback(window, [](GLFWwindow *window, double xoffset, double yoffset) {
+			std::vector< InputEvent > *event_queue = reinterpret_cast< std::vector< InputEvent > * >(glfwGetWindowUserPointer(window));
+			if (!event_queue) return;
+
+			InputEvent event;
+			std::memset(&event, '\0', sizeof(event));
+
+			event.type = InputEvent::MouseWheel;
+			event.wheel.x = float(xoffset);
+			event.wheel.y = float(yoffset);
+
+			event_queue->emplace_back(event);
+		});
+
+		glfwSetKeyCallback(window, [](GLFWwindow *window, int key, int scancode, int action, int mods) {
+			std::vector< InputEvent > *event_queue = reinterpret_cast< std::vector< InputEvent > * >(glfwGetWindowUserPointer(window));
+			if (!event_queue) return;
+
+			InputEvent event;
+			std::memset(&event, '\0', sizeof(event));
+
+			if (action == GLFW_PRESS) {
+				event.type = InputEvent::KeyDown;
+			} else if (action == GLFW_RELEASE) {
+				event.type = InputEvent::KeyUp;
+			} else if (action == GLFW_REPEAT) {
+				//ignore repeats
+				return;
+			} else {
+				std::cerr << "Strange: Got unrecognized button action from GLFW." << std::endl;
+				return;
+			}
+			event.key.key = key;
+			event.key.mods = mods;
+
+			event_queue->emplace_back(event);
+		});
+	}
+
+	//setup time handling:
+	std::chrono::high_resolution_clock::time_point before = std::chrono::high_resolution_clock::now();
+	std::chrono::high_resolution_clock::time_point last_memory_report = before;
+
+	uint32_t frames_rendered = 0;
+
+	while (true) {
+		//stop after the configured number of frames (if any):
+		if (configuration.frames != 0 && frames_rendered >= configuration.frames) break;
+
+		Profiler::Scope frame_scope(profiler, "frame");
+
+		{ //event handling:
+			Profiler::Scope scope(profiler, "events");
+
+			if (window) {
+				if (glfwWindowShouldClose(window)) break;
+				glfwPollEvents();
+			}
+
+			//deliver all input events to application:
+			for (InputEvent const &input : event_queue) {
+				application.on_input(input);
+			}
+			event_queue.clear();
+		}
+
+		{ //elapsed time handling:
+			Profiler::Scope scope(profiler, "update");
+
+			std::chrono::high_resolution_clock::time_point after = std::chrono::high_resolution_clock::now();
+			float dt = float(std::chrono::duration< double >(after - before).count());
+			before = after;
+
+			dt = std::min(dt, 0.1f); //lag if frame rate dips too low
+
+			application.update(dt);
+
+			//periodic memory statistics:
+			if (configuration.memory_report_interval != 0
+			 && std::chrono::duration< double >(after - last_memory_report).count() >= configuration.memory_report_interval) {
+				last_memory_report = after;
+				helpers.report_memory(std::cout);
+			}
+		}
+
+		uint32_t workspace_index;
+		{ //acquire a workspace:
+			Profiler::Scope scope(profiler, "wait workspace");
+
+			assert(next_workspace < workspaces.size());
+			workspace_index = next_workspace;
+			next_workspace = (next_workspace + 1) % workspaces.size();
+
+			current_frame += 1;
+
+			//wait until the workspace's previous frame is done:
+			wait_frame(workspaces[workspace_index].frame);
+
+			//mark the workspace as in use by this frame:
+			workspaces[workspace_index].frame = current_frame;
+
+			//let helpers reclaim anything the workspace was using: (and destroy anything finished frames were using)
+			helpers.begin_workspace(workspace_index);
+
+			//the workspace's timestamps are ready now:
+			collect_gpu_timings(workspace_index);
+
+			//secondary command buffers recorded by record_parallel are done, so can be re-recorded:
+			for (auto &slot : workspaces[workspace_index].recording_slots) {
+				VK( vkResetCommandPool(device, slot.command_pool, 0) );
+				slot.used = 0;
+			}
+		}
+
+		VkSemaphore compute_done = VK_NULL_HANDLE;
+		{ //queue async compute work (if any) -- before acquiring an image, so it can start as soon as possible:
+			Profiler::Scope scope(profiler, "compute");
+
+			PerWorkspace &workspace = workspaces[workspace_index];
+
+			//(safe to reset: the workspace's previous frame waited on its compute work, and that frame is done)
+			VK( vkResetCommandPool(device, workspace.compute_command_pool, 0) );
+
+			VkCommandBufferBeginInfo begin_info{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+			};
+			VK( vkBeginCommandBuffer(workspace.compute_command_buffer, &begin_info) );
+
+			bool recorded = application.compute(*this, ComputeParams{
+				.workspace_index = workspace_index,
+				.command_buffer = workspace.compute_command_buffer,
+			});
+
+			VK( vkEndCommandBuffer(workspace.compute_command_buffer) );
+
+			if (recorded) {
+				VkTimelineSemaphoreSubmitInfo timeline_info{
+					.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+					.signalSemaphoreValueCount = 1,
+					.pSignalSemaphoreValues = &current_frame,
+				};
+				VkSubmitInfo submit_info{
+					.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+					.pNext = &timeline_info,
+					.commandBufferCount = 1,
+					.pCommandBuffers = &workspace.compute_command_buffer,
+					.signalSemaphoreCount = 1,
+					.pSignalSemaphores = &compute_timeline,
+				};
+				VK( vkQueueSubmit(compute_queue, 1, &submit_info, VK_NULL_HANDLE) );
+				compute_done = compute_timeline;
+			}
+		}
+
+		uint32_t image_index = -1U;
+		{ //acquire an image:
+			Profiler::Scope scope(profiler, "acquire");
+
+			if (configuration.headless) {
+				//"acquire" the next offscreen image in the ring:
+				image_index = next_headless_image;
+				next_headless_image = (next_headless_image + 1) % uint32_t(headless_swapchain.size());
+
+				//wait until the image is done being "presented":
+				HeadlessSwapchainImage &headless = headless_swapchain[image_index];
+				VkSemaphoreWaitInfo wait_info{
+					.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+					.semaphoreCount = 1,
+					.pSemaphores = &headless_timeline,
+					.pValues = &headless.presented_frame,
+				};
+				VK( vkWaitSemaphores(device, &wait_info, UINT64_MAX) );
+
+				//the previous frame's copy (if any) is now done, so it can be written out:
+				if (!headless.save_to.empty()) {
+					write_headless_frame(headless);
+				}
+
+				//signal image_available, just as vkAcquireNextImageKHR would:
+				VkSubmitInfo submit_info{
+					.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+					.signalSemaphoreCount = 1,
+					.pSignalSemaphores = &workspaces[workspace_index].image_available,
+				};
+				VK( vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) );
+			} else {
+			retry:
+				//Ask the swapchain for the next image index -- note careful return handling:
+				if (VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, workspaces[workspace_index].image_available, VK_NULL_HANDLE, &image_index);
+				    result == VK_ERROR_OUT_OF_DATE_KHR) {
+					//if the swapchain is out-of-date (e.g., because the window was resized), recreate it and try again:
+					std::cerr << "Recreating swapchain because vkAcquireNextImageKHR returned " << string_VkResult(result) << "." << std::endl;
+					recreate_swapchain();
+					on_swapchain();
+					goto retry;
+				} else if (result == VK_SUBOPTIMAL_KHR) {
+					//if the swapchain is suboptimal, render to it and recreate it later:
+					std::cerr << "Suboptimal swapchain format -- ignoring for the moment." << std::endl;
+				} else if (result != VK_SUCCESS) {
+					//other non-success results are genuine errors:
+					throw std::runtime_error("Failed to acquire swapchain image (" + std::string(string_VkResult(result)) + ")!");
+				}
+
+				//an image came from the current swapchain, so replaced swapchains are done presenting:
+				// (hand them off to be destroyed once the frames that used their images are done, too)
+				for (auto const &destroy : retired_swapchains) {
+					helpers.destroy_later(destroy);
+				}
+				retired_swapchains.clear();
+			}
+		}
+
+		{ //call render function:
+			Profiler::Scope scope(profiler, "render");
+
+			application.render(*this, RenderParams{
+				.workspace_index = workspace_index,
+				.image_index = image_index,
+				.frame = current_frame,
+				.image_available = workspaces[workspace_index].image_available,
+				.image_done = swapchain_image_dones[image_index],
+				.frame_done = frame_timeline,
+				.compute_done = compute_done,
+			});
+		}
+
+		{ //present the image:
+			Profiler::Scope scope(profiler, "present");
+
+			if (configuration.headless) {
+				HeadlessSwapchainImage &headless = headless_swapchain[image_index];
+
+				VkCommandBuffer copy_command = VK_NULL_HANDLE;
+				if (!configuration.save_frames.empty()) {
+					//copy into the other readback, since the writer may still be reading this image's previous frame from the latest one:
+					headless.readback = (headless.readback + 1) % uint32_t(headless.readbacks.size());
+					HeadlessSwapchainImage::Readback &readback = headless.readbacks[headless.readback];
+
+					//the copy will overwrite the buffer, so the writer must be done reading it:
+					// (it was handed off a whole ring of frames ago, so it is almost always done)
+					if (readback.buffer_released.valid()) {
+						readback.buffer_released.get();
+					}
+					copy_command = readback.copy_command;
+
+					char number[16];
+					std::snprintf(number, sizeof(number), "%06u", saved_frames);
+					saved_frames += 1;
+					headless.save_to = configuration.save_frames + number + ".ppm";
+				}
+
+				//"present" the image by waiting for rendering to finish, (optionally) copying it to the host, and advancing headless_timeline:
+				headless.presented_frame = current_frame;
+				VkTimelineSemaphoreSubmitInfo timeline_info{
+					.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+					.signalSemaphoreValueCount = 1,
+					.pSignalSemaphoreValues = &headless.presented_frame,
+				};
+				VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+				VkSubmitInfo submit_info{
+					.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+					.pNext = &timeline_info,
+					.waitSemaphoreCount = 1,
+					.pWaitSemaphores = &swapchain_image_dones[image_index],
+					.pWaitDstStageMask = &wait_stage,
+					.commandBufferCount = (copy_command != VK_NULL_HANDLE ? 1u : 0u),
+					.pCommandBuffers = &copy_command,
+					.signalSemaphoreCount = 1,
+					.pSignalSemaphores = &headless_timeline,
+				};
+				VK( vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE) );
+			} else {
+				//queue the work for presentation:
+				VkPresentInfoKHR present_info{
+					.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+					.waitSemaphoreCount = 1,
+					.pWaitSemaphores = &swapchain_image_dones[image_index],
+					.swapchainCount = 1,
+					.pSwapchains = &swapchain,
+					.pImageIndices = &image_index,
+				};
+
+				assert(present_queue);
+
+				//note, again, the careful return handling:
+				if (VkResult result = vkQueuePresentKHR(present_queue, &present_info);
+				    result == VK_ERROR_OUT_OF_DATE_KHR) {
+					std::cerr << "Recreating swapchain because vkQueuePresentKHR returned " << string_VkResult(result) << "." << std::endl;
+					recreate_swapchain();
+					on_swapchain();
+				} else if (result == VK_SUBOPTIMAL_KHR) {
+					std::cerr << "Suboptimal swapchain format - ignoring for the moment." << std::endl;
+				} else if (result != VK_SUCCESS) {
+					throw std::runtime_error("failed to queue presentation of image (" + std::string(string_VkResult(result)) + ")!");
+				}
+			}
+		}
+
+		frames_rendered += 1;
+	}
+
+	//hand any frames still being copied to the writers and wait for them to be written:
+	if (frame_writers) {
+		for (HeadlessSwapchainImage &headless : headless_swapchain) {
+			if (headless.save_to.empty()) continue;
+			VkSemaphoreWaitInfo wait_info{
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+				.semaphoreCount = 1,
+				.pSemaphores = &headless_timeline,
+				.pValues = &headless.presented_frame,
+			};
+			VK( vkWaitSemaphores(device, &wait_info, UINT64_MAX) );
+			write_headless_frame(headless);
+		}
+		frame_writers->wait_idle();
+	}
+
+	if (!gpu_timings.empty()) {
+		report_gpu_timings(std::cout);
+	}
+
+	if (!configuration.trace_file.empty()) {
+		profiler.write_chrome_trace(configuration.trace_file);
+		std::cout << "Wrote trace of the last " << std::min< uint64_t >(profiler.next, Profiler::Capacity) << " main loop phases to '" << configuration.trace_file << "'." << std::endl;
+	}
+
+	//tear down event handling:
+	if (window) {
+		glfwSetMouseButtonCallback(window, nullptr);
+		glfwSetCursorPosCallback(window, nullptr);
+		glfwSetScrollCallback(window, nullptr);
+		glfwSetKeyCallback(window, nullptr);
+
+		glfwSetWindowUserPointer(window, nullptr);
+	}
+}
+
+void RTG::write_headless_frame(HeadlessSwapchainImage &headless) {
+	assert(frame_writers);
+	assert(!headless.save_to.empty());
+	HeadlessSwapchainImage::Readback &readback = headless.readbacks[headless.readback];
+	assert(!readback.buffer_released.valid());
+
+	//the writer signals this as soon as it is done reading from the mapped buffer:
+	auto released = std::make_shared< std::promise< void > >();
+	readback.buffer_released = released->get_future();
+
+	uint8_t const *pixels = reinterpret_cast< uint8_t const * >(readback.buffer.allocation.data());
+	VkExtent2D extent = swapchain_extent;
+	bool bgra = (surface_format.format == VK_FORMAT_B8G8R8A8_SRGB || surface_format.format == VK_FORMAT_B8G8R8A8_UNORM);
+	std::string filename = std::move(headless.save_to);
+	headless.save_to.clear();
+
+	frame_writers->run([released, pixels, extent, bgra, filename]() {
+		//convert the 4-byte pixels to the RGB rows that PPM expects:
+		std::vector< uint8_t > rgb(size_t(extent.width) * extent.height * 3);
+		{
+			uint8_t const *src = pixels;
+			uint8_t *dst = rgb.data();
+			for (size_t i = 0; i < size_t(extent.width) * extent.height; ++i) {
+				dst[0] = (bgra ? src[2] : src[0]);
+				dst[1] = src[1];
+				dst[2] = (bgra ? src[0] : src[2]);
+				src += 4;
+				dst += 3;
+			}
+		}
+		released->set_value(); //done with mapped memory; RTG can copy the next frame into it
+
+		std::ofstream out(filename, std::ios::binary);
+		out << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+		out.write(reinterpret_cast< char const * >(rgb.data()), rgb.size());
+		if (!out) {
+			std::cerr << "Failed to write frame to '" << filename << "'." << std::endl;
+		}
+	});
+}
+
+uint64_t RTG::completed_frame() const {
+	uint64_t value = 0;
+	VK( vkGetSemaphoreCounterValue(device, frame_timeline, &value) );
+	return value;
+}
+
+void RTG::wait_frame(uint64_t frame) const {
+	if (frame == 0) return;
+	VkSemaphoreWaitInfo wait_info{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &frame_timeline,
+		.pValues = &frame,
+	};
+	VK( vkWaitSemaphores(device, &wait_info, UINT64_MAX) );
+}
+
+std::vector< VkCommandBuffer > RTG::record_parallel(
+	uint32_t workspace_index,
+	VkCommandBufferInheritanceInfo const &inheritance,
+	uint32_t count,
+	std::function< void(VkCommandBuffer, uint32_t begin, uint32_t end) > const &record
+) {
+	assert(workspace_index < workspaces.size());
+	PerWorkspace &workspace = workspaces[workspace_index];
+	assert(workspace.recording_slots.size() == recording_threads);
+
+	if (count == 0) return {};
+
+	//one slice per thread, unless that would make slices too small:
+	uint32_t slices = std::min(recording_threads, (count + MinRecordingSlice - 1) / MinRecordingSlice);
+	assert(slices >= 1);
+
+	//buffers recorded for use inside a render pass (or dynamic rendering) continue it:
+	bool render_pass_continue = (inheritance.renderPass != VK_NULL_HANDLE);
+	for (auto next = reinterpret_cast< VkBaseInStructure const * >(inheritance.pNext); next != nullptr; next = next->pNext) {
+		if (next->sType == VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO) render_pass_continue = true;
+	}
+
+	std::vector< VkCommandBuffer > command_buffers(slices, VK_NULL_HANDLE);
+	std::vector< std::exception_ptr > errors(slices);
+
+	//record slice 'i' using recording slot 'i' (so no two threads share a command pool):
+	auto record_slice = [&](uint32_t i) {
+		Profiler::Scope scope(profiler, "record slice");
+		try {
+			PerWorkspace::RecordingSlot &slot = workspace.recording_slots[i];
+			if (slot.used == slot.command_buffers.size()) {
+				VkCommandBufferAllocateInfo alloc_info{
+					.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+					.commandPool = slot.command_pool,
+					.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+					.commandBufferCount = 1,
+				};
+				slot.command_buffers.emplace_back(VK_NULL_HANDLE);
+				VK( vkAllocateCommandBuffers(device, &alloc_info, &slot.command_buffers.back()) );
+			}
+			VkCommandBuffer command_buffer = slot.command_buffers[slot.used];
+			slot.used += 1;
+
+			VkCommandBufferBeginInfo begin_info{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+				.flags = VkCommandBufferUsageFlags(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+				       | (render_pass_continue ? VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT : 0)),
+				.pInheritanceInfo = &inheritance,
+			};
+			VK( vkBeginCommandBuffer(command_buffer, &begin_info) );
+
+			//slices differ in size by at most one:
+			uint32_t begin = uint32_t(uint64_t(count) * i / slices);
+			uint32_t end = uint32_t(uint64_t(count) * (i + 1) / slices);
+			record(command_buffer, begin, end);
+
+			VK( vkEndCommandBuffer(command_buffer) );
+
+			command_buffers[i] = command_buffer;
+		} catch (...) {
+			errors[i] = std::current_exception();
+		}
+	};
+
+	for (uint32_t i = 1; i < slices; ++i) {
+		recorders->run([&record_slice, i]() { record_slice(i); });
+	}
+	record_slice(0);
+	if (slices > 1) {
+		recorders->wait_idle();
+	}
+
+	for (auto const &error : errors) {
+		if (error) std::rethrow_exception(error);
+	}
+
+	return command_buffers;
+}
+
+RTG::GPUTimer::GPUTimer(RTG &rtg, uint32_t workspace_index, VkCommandBuffer command_buffer_, std::string const &name) : command_buffer(command_buffer_) {
+	if (!rtg.gpu_timers_supported) return;
+
+	assert(workspace_index < rtg.workspaces.size());
+	PerWorkspace &workspace = rtg.workspaces[workspace_index];
+	if (workspace.timestamp_regions.size() >= GPUTimerRegions) return; //out of queries for this frame
+
+	pool = workspace.timestamp_queries;
+	query = 2 * uint32_t(workspace.timestamp_regions.size());
+	workspace.timestamp_regions.emplace_back(name);
+
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, query);
+}
+
+RTG::GPUTimer::~GPUTimer() {
+	if (pool == VK_NULL_HANDLE) return;
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, query + 1);
+}
+
+void RTG::collect_gpu_timings(uint32_t workspace_index) {
+	PerWorkspace &workspace = workspaces[workspace_index];
+	if (workspace.timestamp_regions.empty()) return;
+
+	uint32_t count = 2 * uint32_t(workspace.timestamp_regions.size());
+
+	//read (value, availability) pairs; the workspace fence has signal'd, so this doesn't wait:
+	std::vector< uint64_t > results(2 * count);
+	VkResult result = vkGetQueryPoolResults(device, workspace.timestamp_queries, 0, count,
+		results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+	);
+	if (result != VK_SUCCESS && result != VK_NOT_READY) {
+		throw std::runtime_error("Failed to read timestamp queries [" + std::string(string_VkResult(result)) + "].");
+	}
+
+	for (uint32_t r = 0; r < workspace.timestamp_regions.size(); ++r) {
+		uint64_t const *start = &results[4 * r]; //(value, available)
+		uint64_t const *end = &results[4 * r + 2];
+		if (start[1] == 0 || end[1] == 0) continue; //region was recorded but never executed
+
+		uint64_t ticks = (end[0] - start[0]) & timestamp_mask;
+		float ms = float(double(ticks) * timestamp_period * 1e-6);
+
+		GPUTimingSamples &samples = gpu_timings[workspace.timestamp_regions[r]];
+		if (samples.ms.size() < GPUTimingWindow) {
+			samples.ms.emplace_back(ms);
+		} else {
+			samples.ms[samples.next] = ms;
+			samples.next = (samples.next + 1) % GPUTimingWindow;
+		}
+	}
+
+	vkResetQueryPool(device, workspace.timestamp_queries, 0, count);
+	workspace.timestamp_regions.clear();
+}
+
+void RTG::report_gpu_timings(std::ostream &out) const {
+	out << "GPU timings (ms, over up to " << GPUTimingWindow << " recent frames):\n";
+	for (auto const &[name, samples] : gpu_timings) {
+		if (samples.ms.empty()) continue;
+
+		std::vector< float > sorted = samples.ms;
+		std::sort(sorted.begin(), sorted.end());
+		double sum = 0.0;
+		for (float ms : sorted) sum += ms;
+		size_t p99 = std::min(sorted.size() - 1, size_t(std::ceil(0.99 * sorted.size())) - 1);
+
+		char line[256];
+		std::snprintf(line, sizeof(line), "  %-24s min %8.3f  avg %8.3f  p99 %8.3f  (%zu samples)",
+			name.c_str(), sorted.front(), sum / sorted.size(), sorted[p99], sorted.size());
+		out << line << '\n';
+	}
+	out.flush();
 }
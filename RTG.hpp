@@ -2,17 +2,22 @@
 
 #include "Helpers.hpp"
 #include "InputEvent.hpp"
+#include "Profiler.hpp"
 
 #include <vulkan/vulkan_core.h>
 
 #include <array>
 #include <optional>
 #include <functional>
+#include <future>
+#include <iosfwd>
+#include <map>
 #include <memory>
 #include <vector>
 #include <string>
 
 struct GLFWwindow;
+struct WorkerPool;
 
 /*
  * Real-time Graphics support framework.
@@ -63,6 +68,7 @@ struct RTG {
 			VkSurfaceFormatKHR{ .format = VK_FORMAT_B8G8R8A8_SRGB, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR},
 		};
 		//requested (priority-ranked) presentation modes for output surface: (will use first available)
+		// `--present-mode <mode>` command-line flag (mode is fifo, mailbox, immediate, or fifo-relaxed; fifo is kept as a fallback)
 		std::vector< VkPresentModeKHR > present_modes{
 			VK_PRESENT_MODE_FIFO_KHR
 		};
@@ -72,8 +78,69 @@ struct RTG {
 		VkExtent2D surface_extent{ .width = 800, .height=540 };
 
 		//how many "workspaces" (frames that can currently be being worked on by the CPU or GPU) to use:
+		// `--workspaces <count>` command-line flag
 		uint32_t workspaces = 2;
 
+		//requested number of swapchain images: (0 picks a default; clamped to what the surface supports)
+		// `--swapchain-images <count>` command-line flag
+		uint32_t swapchain_images = 0;
+
+		//`--profile <name>` sets workspaces, swapchain_images, and present_modes together:
+		//  low-latency: one workspace, as few images as possible, mailbox (or immediate) present mode
+		//  max-throughput: three workspaces, four images, immediate (or mailbox) present mode
+		//  default: the defaults above
+		// (later flags override earlier ones, so e.g. `--profile low-latency --workspaces 2` works)
+
+		//if true, applications should draw with vkCmdBeginRendering instead of VkRenderPass/VkFramebuffer objects:
+		// (enables the Vulkan 1.3 dynamicRendering feature)
+		// `--dynamic-rendering` command-line flag
+		bool dynamic_rendering = false;
+
+		//if true, don't create a window or surface; render into a ring of offscreen images instead:
+		// `--headless` command-line flag
+		bool headless = false;
+
+		//if non-zero, stop running after this many frames have been rendered:
+		// `--frames <count>` command-line flag
+		uint32_t frames = 0;
+
+		//threads (including the main thread) used by RTG::record_parallel: (0 to pick based on core count)
+		// `--recording-threads <count>` command-line flag
+		uint32_t recording_threads = 0;
+
+		//if non-empty, write a Chrome trace of recent main loop phases to this file when run() returns:
+		// `--trace <file>` command-line flag
+		std::string trace_file = "";
+
+		//file used to keep the pipeline cache between runs: (empty to not load or save the cache)
+		// `--pipeline-cache <file>` command-line flag
+		std::string pipeline_cache_file = "pipeline-cache.bin";
+
+		//size of the staging ring used by Helpers::stream_to_buffer: (must hold one frame's worth of streamed data)
+		VkDeviceSize staging_ring_size = 32 * 1024 * 1024;
+
+		//per-frame limits on what Streamer uploads: (the byte budget is also capped at staging_ring_size / (workspaces + 1))
+		// `--stream-budget <KiB>` command-line flag
+		VkDeviceSize stream_budget = 8 * 1024 * 1024;
+		// `--stream-copies <count>` command-line flag
+		uint32_t stream_copies = 64;
+
+		//soft limit on device memory Helpers may hold in each memory heap: (0 for no limit)
+		// allocations that would go past it throw instead of letting the driver page memory around
+		// `--memory-limit <MiB>` command-line flag
+		VkDeviceSize memory_limit = 0;
+		//if true, also treat each heap's VK_EXT_memory_budget budget (which accounts for other processes) as a soft limit:
+		// `--memory-limit budget` command-line flag
+		bool memory_limit_budget = false;
+
+		//if non-zero, print Helpers' memory statistics every this many seconds while running:
+		// `--memory-report <seconds>` command-line flag
+		uint32_t memory_report_interval = 0;
+
+		//if non-empty (and in headless mode), write every rendered frame to <save_frames>NNNNNN.ppm:
+		// `--save-frames <prefix>` command-line flag
+		std::string save_frames = "";
+
 		//for configuration construction + management:
 		Configuration() = default;
 		void parse(int argc, char **argv); //parse command-line options; throws on error
@@ -95,16 +162,38 @@ struct RTG {
 	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
 	VkDevice device = VK_NULL_HANDLE;
 
+	//Vulkan 1.2 device features that were enabled: (optional features are only enabled if the device supports them)
+	VkPhysicalDeviceVulkan12Features enabled_features_12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	//Vulkan 1.3 device features that were enabled:
+	VkPhysicalDeviceVulkan13Features enabled_features_13{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES };
+
+	//VK_EXT_memory_budget was enabled: (so Helpers can query per-heap budget and usage)
+	bool memory_budget_supported = false;
+
+	//pass this to every vkCreate*Pipelines call; it is loaded from / saved to configuration.pipeline_cache_file:
+	VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+	void create_pipeline_cache(); //(used by RTG::RTG) loads the cache file if it matches this device + driver
+	void destroy_pipeline_cache(); //(used by RTG::~RTG) saves the cache file, then destroys pipeline_cache
+
 	//queue for graphics and transfer operations:
 	std::optional< uint32_t > graphics_queue_family;
 	VkQueue graphics_queue = VK_NULL_HANDLE;
 
-	//queue for present operations:
+	//queue for bulk uploads: (a transfer-only "DMA" family when the device has one; otherwise the graphics queue)
+	// when transfer_queue_family != graphics_queue_family, resources need queue family ownership transfers (see Helpers::transfer_to_*)
+	std::optional< uint32_t > transfer_queue_family;
+	VkQueue transfer_queue = VK_NULL_HANDLE;
+
+	//queue for async compute: (a compute family without graphics when the device has one; otherwise the graphics queue)
+	std::optional< uint32_t > compute_queue_family;
+	VkQueue compute_queue = VK_NULL_HANDLE;
+
+	//queue for present operations: (not used in headless mode)
 	std::optional< uint32_t > present_queue_family;
 	VkQueue present_queue = VK_NULL_HANDLE;
 
 	//-------------------------------------------------
-	//Handles for the window and surface:
+	//Handles for the window and surface: (null in headless mode)
 
 	GLFWwindow *window = nullptr;
 
@@ -125,20 +214,137 @@ struct RTG {
 	std::vector< VkSemaphore > swapchain_image_dones; //image is done being rendered to and is ready for presentation
 
 	//swapchain management: (used from RTG::RTG(), RTG::~RTG(), and RTG::run() [on resize])
-	void recreate_swapchain();
+	void recreate_swapchain(); //does not wait for the device to be idle; the old swapchain goes to retired_swapchains
 	void destroy_swapchain(); //NOTE: swapchain must exist
+
+	//destroy functions for replaced swapchains (with their image views and image_done semaphores):
+	// no fence tells when a present is done waiting on its image_done semaphore, so these are only handed to
+	// Helpers::destroy_later once an acquire from a newer swapchain succeeds (by then, the presentation engine has moved on).
+	std::vector< std::function< void() > > retired_swapchains;
+
+	//In headless mode, the "swapchain" is a ring of offscreen images owned by RTG:
+	struct HeadlessSwapchainImage {
+		Helpers::AllocatedImage image; //rendered to by the application
+		uint64_t presented_frame = 0; //last frame to (pretend) present the image; done once headless_timeline reaches this
+
+		//used when saving frames:
+		struct Readback {
+			Helpers::AllocatedBuffer buffer; //host-visible, mapped copy of the image
+			VkCommandBuffer copy_command = VK_NULL_HANDLE; //copies image -> buffer; (pre-recorded) submitted as the "present" step
+			std::future< void > buffer_released; //if valid, becomes ready when the writer is done reading from buffer
+		};
+		//presents alternate between readbacks, so copying a frame never waits on the writer reading the image's previous frame:
+		std::array< Readback, 2 > readbacks;
+		uint32_t readback = 0; //readback used by the latest present
+		std::string save_to = ""; //if non-empty, readbacks[readback] holds a frame to be written to this file once presented_frame is done
+	};
+	std::vector< HeadlessSwapchainImage > headless_swapchain; //parallel to swapchain_images in headless mode
+	uint32_t next_headless_image = 0; //next image to "acquire" in headless mode
+	VkCommandPool headless_command_pool = VK_NULL_HANDLE; //copy_commands are allocated from here
+	VkSemaphore headless_timeline = VK_NULL_HANDLE; //timeline semaphore; reaches N when frame N's image is done being "presented"
+
+	//background threads that write saved frames to disk: (only created when saving frames)
+	std::unique_ptr< WorkerPool > frame_writers;
+	uint32_t saved_frames = 0; //used to number saved frame files
+	//hand a presented headless image's buffer to the frame writers: (presented_frame must be done)
+	void write_headless_frame(HeadlessSwapchainImage &headless);
 	
 	//Workspaces hold dynamic state that must be kept separate between frames.
 	// RTG stores some synchronization primitives per workspace.
 	// (The bulk of per-workspace data will be managed by the Application.)
 	struct PerWorkspace {
-		VkFence workspace_available = VK_NULL_HANDLE; //workspace is ready for a new render
-		VkSemaphore image_available = VK_NULL_HANDLE; //the image is ready to write to
+		uint64_t frame = 0; //last frame to use this workspace; the workspace is ready for a new render once that frame is done
+		VkSemaphore image_available = VK_NULL_HANDLE; //the image is ready to write to (binary, since vkAcquireNextImageKHR signals it)
+
+		//used for Application::compute:
+		VkCommandPool compute_command_pool = VK_NULL_HANDLE; //for compute_queue_family; reset every frame
+		VkCommandBuffer compute_command_buffer = VK_NULL_HANDLE; //passed to Application::compute
+
+		//used for GPU timing:
+		VkQueryPool timestamp_queries = VK_NULL_HANDLE; //(start, end) timestamp pairs; reset when the workspace is next used
+		std::vector< std::string > timestamp_regions; //region name for each pair of queries written this frame
+
+		//used by record_parallel -- one per recording thread, so recording needs no locks:
+		struct RecordingSlot {
+			VkCommandPool command_pool = VK_NULL_HANDLE; //graphics_queue_family; reset when the workspace is next used
+			std::vector< VkCommandBuffer > command_buffers; //secondary; allocated as needed and reused every frame
+			uint32_t used = 0; //command_buffers handed out so far this frame
+		};
+		std::vector< RecordingSlot > recording_slots;
 	};
 	std::vector< PerWorkspace > workspaces;
 	//^^ this size could probably be hardcoded (it will almost always be 2 unless you want bottlenecks!), but I'm leaving it variable at the moment.
 	uint32_t next_workspace = 0;
 
+	//------------------------------
+	//Frame pacing:
+	// Frames are numbered 1, 2, 3, ... and all waiting is done by frame number using timeline semaphores:
+	// the application's last submit for frame N signals frame_timeline with N (see RenderParams::frame_done),
+	// so waiting for a workspace, ordering work on other queues, or reclaiming resources is a matter of comparing numbers.
+	VkSemaphore frame_timeline = VK_NULL_HANDLE; //reaches N when all of frame N's work is done
+	VkSemaphore compute_timeline = VK_NULL_HANDLE; //reaches N when Application::compute's work for frame N is done (if there was any)
+	uint64_t current_frame = 0; //number of the frame being worked on (0 before run starts)
+
+	uint64_t completed_frame() const; //number of the last frame whose work is done
+	void wait_frame(uint64_t frame) const; //block until all of frame's work is done (returns immediately for frame 0)
+
+	//------------------------------
+	//GPU timing:
+	// Bracket regions of a workspace's command buffers with GPUTimer objects to measure their GPU time:
+	//   { RTG::GPUTimer timer(rtg, render_params.workspace_index, command_buffer, "shadows"); /* vkCmd... */ }
+	// Results are read back (without stalling) when the workspace is next used and kept per region name.
+	struct GPUTimer {
+		GPUTimer(RTG &rtg, uint32_t workspace_index, VkCommandBuffer command_buffer, std::string const &name); //writes start timestamp
+		~GPUTimer(); //writes end timestamp
+		GPUTimer(GPUTimer const &) = delete;
+
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		VkQueryPool pool = VK_NULL_HANDLE; //null if not timing (unsupported, or out of queries this frame)
+		uint32_t query = 0; //start timestamp query; end is query + 1
+	};
+
+	static constexpr uint32_t GPUTimerRegions = 64; //timed regions per workspace per frame; later regions are not timed
+	static constexpr uint32_t GPUTimingWindow = 256; //statistics are over this many most recent samples
+
+	bool gpu_timers_supported = false; //needs hostQueryReset and timestamps on the graphics queue
+	double timestamp_period = 1.0; //nanoseconds per timestamp tick
+	uint64_t timestamp_mask = ~0ULL; //valid bits of timestamp values
+
+	struct GPUTimingSamples {
+		std::vector< float > ms; //most recent samples (in milliseconds), used as a ring buffer once full
+		uint32_t next = 0; //next sample to overwrite once full
+	};
+	std::map< std::string, GPUTimingSamples > gpu_timings;
+
+	void collect_gpu_timings(uint32_t workspace_index); //(used by run) read a workspace's finished timestamps, then reset its queries
+	void report_gpu_timings(std::ostream &) const; //print min/avg/p99 per region (run does this on exit)
+
+	//------------------------------
+	//Parallel command recording:
+	// Splits [0, count) into contiguous slices and calls record(command_buffer, begin, end) for each slice
+	// on its own thread, each recording into a secondary command buffer from that thread's pool in the workspace.
+	// Returns the recorded buffers in slice order (ready for vkCmdExecuteCommands); empty if count is zero.
+	//   inheritance describes the render pass/subpass/framebuffer the buffers will be executed in
+	//   (or chains a VkCommandBufferInheritanceRenderingInfo, if they will be executed inside vkCmdBeginRendering).
+	// Call from the main thread (the calling thread records the first slice); rethrows the first exception thrown by record.
+	std::vector< VkCommandBuffer > record_parallel(
+		uint32_t workspace_index,
+		VkCommandBufferInheritanceInfo const &inheritance,
+		uint32_t count,
+		std::function< void(VkCommandBuffer, uint32_t begin, uint32_t end) > const &record
+	);
+
+	static constexpr uint32_t MinRecordingSlice = 256; //smaller slices aren't worth a thread hop
+
+	uint32_t recording_threads = 1; //including the main thread; also the number of recording slots per workspace
+	std::unique_ptr< WorkerPool > recorders; //recording_threads - 1 worker threads (null if recording_threads is 1)
+
+	//------------------------------
+	//CPU profiling:
+	// run() records the time taken by each phase of every frame ("events", "update", "wait workspace", "acquire", "render", ...);
+	// applications may record their own spans with Profiler::Scope scope(rtg.profiler, "name");
+	Profiler profiler;
+
 	//------------------------------
 	//Main loop stuff:
 
@@ -148,6 +354,7 @@ struct RTG {
 	void run(Application &);
 
 	struct SwapchainEvent;
+	struct ComputeParams;
 	struct RenderParams;
 
 	//inherit from application to make something to pass to run:
@@ -161,6 +368,12 @@ struct RTG {
 		//advance time for dt seconds: (called every frame)
 		virtual void update(float dt) = 0;
 
+		//record async compute work for a frame: (called every frame, after update and before render; optional)
+		// record into the (already begun) command buffer and return true to have it submitted to compute_queue.
+		// If true is returned, render *must* wait on RenderParams::compute_done (with value RenderParams::frame).
+		// NOTE: resources shared with render need queue family ownership transfers if compute_queue_family != graphics_queue_family.
+		virtual bool compute(RTG &, ComputeParams const &) { return false; }
+
 		//queue commands to render a frame: (called every frame)
 		virtual void render(RTG &, RenderParams const &) = 0;
 	};
@@ -179,13 +392,21 @@ struct RTG {
 		std::vector< VkImageView > const &image_views; //swapchain image views
 	};
 
+	//parameters passed to Application::compute() when asking application for a frame's compute work:
+	struct ComputeParams {
+		uint32_t workspace_index; //which per-render workspace this frame uses
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE; //record compute work here; RTG begins, ends, and submits it
+	};
+
 	//parameters passed to Application::draw() when asking application to render a frame:
 	struct RenderParams {
 		uint32_t workspace_index; //which per-render workspace to use (e.g., you probably want a command buffer per workspace)
 		uint32_t image_index; //which swapchain image to render into
+		uint64_t frame; //number of this frame (increases by one every frame)
 		VkSemaphore image_available = VK_NULL_HANDLE; //nothing should use the swapchain image until this is signal'd
 		VkSemaphore image_done = VK_NULL_HANDLE; //this should be signal'd when the image is done being written to
-		VkFence workspace_available = VK_NULL_HANDLE; //this should be signal'd when *all* work is done for the frame
+		VkSemaphore frame_done = VK_NULL_HANDLE; //timeline semaphore; signal it with value `frame` when *all* work is done for the frame
+		VkSemaphore compute_done = VK_NULL_HANDLE; //if not null, Application::compute queued work; wait on this timeline semaphore for value `frame` before using its results
 	};
 
 };
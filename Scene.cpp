@@ -0,0 +1,142 @@
+#include "Scene.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <stdexcept>
+
+Scene::Scene(std::string const &filename_) : filename(filename_) {
+	//map the whole file read-only:
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open scene '" + filename + "'.");
+	file_handle = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < LONGLONG(sizeof(Header))) {
+		CloseHandle(file);
+		throw std::runtime_error("Scene '" + filename + "' is too small to be a scene file.");
+	}
+	mapping_size = size_t(size.QuadPart);
+	HANDLE mapping_object = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_object == nullptr) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to create a mapping of scene '" + filename + "'.");
+	}
+	mapping_handle = mapping_object;
+	mapping = MapViewOfFile(mapping_object, FILE_MAP_READ, 0, 0, 0);
+	if (mapping == nullptr) {
+		CloseHandle(mapping_object);
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map scene '" + filename + "'.");
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("Failed to open scene '" + filename + "'.");
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < off_t(sizeof(Header))) {
+		close(fd);
+		throw std::runtime_error("Scene '" + filename + "' is too small to be a scene file.");
+	}
+	mapping_size = size_t(info.st_size);
+	void *mapped = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //(the mapping keeps the file alive)
+	if (mapped == MAP_FAILED) throw std::runtime_error("Failed to map scene '" + filename + "'.");
+	mapping = mapped;
+	//uploads read each stream front to back, so ask for aggressive read-ahead:
+	madvise(mapped, mapping_size, MADV_SEQUENTIAL);
+	#endif
+
+	//check that the header and sections make sense: (nothing else is looked at until used)
+	try {
+		char const *base = reinterpret_cast< char const * >(mapping);
+		header = reinterpret_cast< Header const * >(base);
+
+		if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0) throw std::runtime_error("doesn't start with the scene magic number.");
+		if (header->version != Version) throw std::runtime_error("is version " + std::to_string(header->version) + ", but this code reads version " + std::to_string(Version) + ".");
+
+		//point a span at a section, making sure it lies inside the file and is aligned:
+		auto section = [&]< typename T >(std::span< T const > *span, char const *what, uint64_t offset, uint64_t count) {
+			if (offset % SectionAlignment != 0) {
+				throw std::runtime_error(std::string("has a misaligned ") + what + " section.");
+			}
+			if (offset > mapping_size || count > (mapping_size - offset) / sizeof(T)) {
+				throw std::runtime_error(std::string("has a ") + what + " section that extends past the end of the file.");
+			}
+			*span = std::span< T const >(reinterpret_cast< T const * >(base + offset), size_t(count));
+		};
+		section(&meshes, "meshes", header->meshes_offset, header->mesh_count);
+		section(&materials, "materials", header->materials_offset, header->material_count);
+		section(&positions, "positions", header->positions_offset, header->vertex_count);
+		section(&attributes, "attributes", header->attributes_offset, header->vertex_count);
+		section(&indices, "indices", header->indices_offset, header->index_count);
+
+		//meshes must refer to vertices, indices, and materials that exist:
+		// (index values aren't checked -- that would mean reading the whole index stream)
+		for (Mesh const &mesh : meshes) {
+			if (uint64_t(mesh.first_vertex) + mesh.vertex_count > header->vertex_count
+			 || uint64_t(mesh.first_index) + mesh.index_count > header->index_count
+			 || (mesh.material != -1U && mesh.material >= header->material_count)) {
+				throw std::runtime_error("has a mesh that refers past the end of the vertex, index, or material sections.");
+			}
+		}
+	} catch (std::runtime_error &e) {
+		unmap();
+		throw std::runtime_error("Scene '" + filename + "' " + e.what());
+	}
+}
+
+Scene::~Scene() {
+	unmap();
+}
+
+void Scene::unmap() {
+	if (mapping == nullptr) return;
+
+	#if defined(_WIN32)
+	UnmapViewOfFile(mapping);
+	CloseHandle(HANDLE(mapping_handle));
+	CloseHandle(HANDLE(file_handle));
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+	#else
+	munmap(const_cast< void * >(mapping), mapping_size);
+	#endif
+
+	mapping = nullptr;
+	mapping_size = 0;
+	header = nullptr;
+	meshes = {};
+	materials = {};
+	positions = {};
+	attributes = {};
+	indices = {};
+}
+
+Scene::Buffers Scene::upload(Helpers &helpers) const {
+	Buffers buffers;
+	Helpers::UploadBatch batch;
+
+	//one buffer per stream, each filled directly from the mapping:
+	auto stream = [&](Helpers::AllocatedBuffer *buffer, void const *data, size_t size, VkBufferUsageFlags usage) {
+		if (size == 0) return; //(Vulkan doesn't allow empty buffers)
+		*buffer = helpers.create_buffer(size, usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, Helpers::Upload);
+		batch.add(data, size, *buffer);
+	};
+	stream(&buffers.positions, positions.data(), positions.size_bytes(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	stream(&buffers.attributes, attributes.data(), attributes.size_bytes(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	stream(&buffers.indices, indices.data(), indices.size_bytes(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+	//(all three go out together)
+	helpers.transfer_batch(batch);
+
+	return buffers;
+}
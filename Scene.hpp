@@ -0,0 +1,115 @@
+#pragma once
+
+//Binary scene files (.scene), made to be memory-mapped and used in place:
+//
+//  Scene scene("city.scene"); //maps the file; checks the header and section bounds, but parses nothing
+//  Scene::Buffers buffers = scene.upload(rtg.helpers); //vertex/index streams go straight from the mapping to the GPU
+//  for (Scene::Mesh const &mesh : scene.meshes) { ... vkCmdDrawIndexed(cb, mesh.index_count, 1, mesh.first_index, mesh.first_vertex, 0); ... }
+//
+// Files are made from .obj files by the convert-scene tool (see convert-scene.cpp).
+//
+// Layout: (all little-endian; every section starts on a 16-byte boundary so it can be used directly from the mapping)
+//   Header
+//   Mesh[header.mesh_count]
+//   Material[header.material_count]
+//   Position[header.vertex_count] //positions of all meshes' vertices, back to back (a separate stream, for depth-only passes)
+//   Attributes[header.vertex_count] //everything else about those vertices
+//   uint32_t[header.index_count] //triangle list indices, relative to their mesh's first_vertex
+
+#include "Helpers.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+struct Scene {
+	//-----------------------
+	//file format:
+
+	static constexpr char Magic[8] = {'n','k','s','c','e','n','e','\0'};
+	static constexpr uint32_t Version = 1;
+	static constexpr uint64_t SectionAlignment = 16;
+
+	struct Header {
+		char magic[8]; //Magic
+		uint32_t version; //Version
+		uint32_t mesh_count;
+		uint32_t material_count;
+		uint32_t reserved; //zero
+		uint64_t vertex_count;
+		uint64_t index_count;
+		//section offsets, in bytes from the start of the file:
+		uint64_t meshes_offset;
+		uint64_t materials_offset;
+		uint64_t positions_offset;
+		uint64_t attributes_offset;
+		uint64_t indices_offset;
+	};
+	static_assert(sizeof(Header) == 80, "Header layout is part of the file format.");
+
+	//a range of vertices and indices drawn with one material:
+	// (32-bit counts match vkCmdDrawIndexed's parameters)
+	struct Mesh {
+		char name[48]; //null-terminated
+		uint32_t first_vertex;
+		uint32_t vertex_count;
+		uint32_t first_index;
+		uint32_t index_count;
+		uint32_t material; //index into materials, or -1U for none
+		uint32_t reserved; //zero
+		float bounds_min[3]; //axis-aligned bounding box of the mesh's positions
+		float bounds_max[3];
+	};
+	static_assert(sizeof(Mesh) == 96, "Mesh layout is part of the file format.");
+
+	struct Material {
+		char name[48]; //null-terminated
+		float base_color[4]; //linear RGBA
+		char base_color_texture[64]; //null-terminated path relative to the scene file, or empty
+	};
+	static_assert(sizeof(Material) == 128, "Material layout is part of the file format.");
+
+	struct Position {
+		float x, y, z;
+	};
+	static_assert(sizeof(Position) == 12, "Position layout is part of the file format.");
+
+	struct Attributes {
+		float normal[3];
+		float texcoord[2];
+	};
+	static_assert(sizeof(Attributes) == 20, "Attributes layout is part of the file format.");
+
+	//-----------------------
+	//loaded scenes:
+
+	explicit Scene(std::string const &filename); //maps the file; throws if it is missing, truncated, or not a scene file
+	Scene(Scene const &) = delete; //you shouldn't be copying a Scene
+	~Scene(); //unmaps the file
+
+	//these all point into the mapping:
+	Header const *header = nullptr;
+	std::span< Mesh const > meshes;
+	std::span< Material const > materials;
+	std::span< Position const > positions;
+	std::span< Attributes const > attributes;
+	std::span< uint32_t const > indices;
+
+	//device-local copies of the vertex and index streams:
+	// (the mapping is passed straight to a Helpers::UploadBatch, so the only copy on the CPU is into staging memory --
+	//  or none at all, when the buffers land in host-visible device-local memory)
+	struct Buffers {
+		Helpers::AllocatedBuffer positions; //VERTEX_BUFFER (and STORAGE_BUFFER)
+		Helpers::AllocatedBuffer attributes; //VERTEX_BUFFER (and STORAGE_BUFFER)
+		Helpers::AllocatedBuffer indices; //INDEX_BUFFER (VK_INDEX_TYPE_UINT32, and STORAGE_BUFFER)
+	};
+	Buffers upload(Helpers &helpers) const; //call helpers.destroy_buffer on each buffer when done
+
+	//internals:
+	std::string filename;
+	void const *mapping = nullptr;
+	size_t mapping_size = 0;
+	void *file_handle = nullptr; //(only used on Windows)
+	void *mapping_handle = nullptr; //(only used on Windows)
+	void unmap(); //(used by the destructor, and by the constructor on errors) releases the mapping and clears the spans
+};
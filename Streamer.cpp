@@ -0,0 +1,369 @@
+#include "Streamer.hpp"
+
+#include "RTG.hpp"
+#include "VK.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+Streamer::Streamer(RTG &rtg_, uint32_t threads) : rtg(rtg_), loaders(threads) {
+}
+
+Streamer::~Streamer() {
+	//loading jobs that haven't started yet should do nothing:
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+		queued.clear();
+	}
+	loaders.wait_idle();
+
+	//every asset that hasn't been released still holds its resources:
+	for (Handle const &asset : assets) {
+		if (asset->buffer.handle != VK_NULL_HANDLE) rtg.helpers.destroy_buffer(std::move(asset->buffer));
+		if (asset->image.handle != VK_NULL_HANDLE) rtg.helpers.destroy_image(std::move(asset->image));
+		asset->state = State::Released;
+	}
+	assets.clear();
+	loaded.clear();
+	uploading.clear();
+}
+
+//----------------------------
+//requests:
+
+Streamer::Handle Streamer::stream_buffer(std::string const &name, std::function< std::vector< uint8_t >() > const &load, VkBufferUsageFlags usage, float priority) {
+	Handle asset = std::make_shared< Asset >();
+	asset->name = name;
+	asset->priority = priority;
+	asset->usage = usage;
+	asset->load = [load](Asset &asset) {
+		asset.data = load();
+		if (asset.data.empty()) throw std::runtime_error("loaded no data (Vulkan doesn't allow empty buffers).");
+	};
+	return enqueue(asset);
+}
+
+Streamer::Handle Streamer::stream_file(std::string const &filename, VkBufferUsageFlags usage, float priority) {
+	return stream_buffer(filename, [filename]() {
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file) throw std::runtime_error("failed to open file.");
+		std::vector< uint8_t > data(size_t(file.tellg()));
+		file.seekg(0);
+		if (!file.read(reinterpret_cast< char * >(data.data()), data.size())) throw std::runtime_error("failed to read file.");
+		return data;
+	}, usage, priority);
+}
+
+Streamer::Handle Streamer::stream_texture(std::string const &filename, float priority) {
+	Handle asset = std::make_shared< Asset >();
+	asset->name = filename;
+	asset->priority = priority;
+	asset->is_texture = true;
+	asset->load = [this, filename](Asset &asset) {
+		asset.texture = KTX2::load(filename);
+		//(decoding runs right here, on this loading thread)
+		asset.texture.prepare(rtg.helpers, nullptr);
+	};
+	return enqueue(asset);
+}
+
+Streamer::Handle Streamer::enqueue(Handle asset) {
+	assets.emplace_back(asset);
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		queued.emplace_back(asset);
+	}
+	//each job loads whichever queued asset has the highest priority when it starts, not necessarily this one:
+	loaders.run([this](){ load_next(); });
+	return asset;
+}
+
+void Streamer::set_priority(Handle const &asset, float priority) {
+	std::lock_guard< std::mutex > lock(mutex);
+	asset->priority = priority;
+}
+
+bool Streamer::ready(Handle const &asset) const {
+	return asset->state == State::Uploaded && rtg.completed_frame() >= asset->ready_frame;
+}
+
+void Streamer::release(Handle const &asset) {
+	State previous;
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		previous = asset->state.exchange(State::Released);
+		auto drop = [&](std::vector< Handle > &list) {
+			list.erase(std::remove(list.begin(), list.end(), asset), list.end());
+		};
+		drop(queued);
+		drop(loaded);
+	}
+	uploading.erase(std::remove(uploading.begin(), uploading.end(), asset), uploading.end());
+	assets.erase(std::remove(assets.begin(), assets.end(), asset), assets.end());
+
+	//frames in flight may still be copying into (or reading from) the resources:
+	if (asset->buffer.handle != VK_NULL_HANDLE) rtg.helpers.destroy_buffer_later(std::move(asset->buffer));
+	if (asset->image.handle != VK_NULL_HANDLE) rtg.helpers.destroy_image_later(std::move(asset->image));
+
+	//a loading thread may still be filling in the CPU data of a Loading asset; load_next drops it once it sees the new state:
+	if (previous != State::Loading) {
+		asset->data = std::vector< uint8_t >();
+		asset->texture.data = std::vector< uint8_t >();
+	}
+}
+
+uint32_t Streamer::waiting() const {
+	uint32_t count = 0;
+	for (Handle const &asset : assets) {
+		State state = asset->state;
+		if (state != State::Uploaded && state != State::Failed && state != State::Released) count += 1;
+	}
+	return count;
+}
+
+//----------------------------
+//loading threads:
+
+void Streamer::load_next() {
+	Handle asset;
+	{ //take the highest-priority queued asset:
+		std::lock_guard< std::mutex > lock(mutex);
+		if (quit || queued.empty()) return; //(released, or shutting down)
+		auto best = std::max_element(queued.begin(), queued.end(), [](Handle const &a, Handle const &b) {
+			return a->priority < b->priority;
+		});
+		asset = std::move(*best);
+		*best = std::move(queued.back());
+		queued.pop_back();
+		asset->state = State::Loading;
+	}
+
+	bool failed = false;
+	{
+		Profiler::Scope scope(rtg.profiler, "stream load");
+		try {
+			asset->load(*asset);
+		} catch (std::exception &e) {
+			asset->error = e.what();
+			failed = true;
+		}
+	}
+
+	std::lock_guard< std::mutex > lock(mutex);
+	State expected = State::Loading;
+	if (!asset->state.compare_exchange_strong(expected, failed ? State::Failed : State::Loaded)) {
+		//released while loading; nobody wants the data:
+		asset->data = std::vector< uint8_t >();
+		asset->texture.data = std::vector< uint8_t >();
+		return;
+	}
+	loaded.emplace_back(std::move(asset));
+}
+
+//----------------------------
+//uploads:
+
+void Streamer::update(VkCommandBuffer command_buffer) {
+	Profiler::Scope scope(rtg.profiler, "stream upload");
+
+	auto fail = [&](Asset &asset, std::string const &error) {
+		asset.error = error;
+		asset.state = State::Failed;
+		std::cerr << "Failed to stream '" << asset.name << "': " << error << std::endl;
+		if (asset.buffer.handle != VK_NULL_HANDLE) rtg.helpers.destroy_buffer_later(std::move(asset.buffer));
+		if (asset.image.handle != VK_NULL_HANDLE) rtg.helpers.destroy_image_later(std::move(asset.image));
+		asset.data = std::vector< uint8_t >();
+		asset.texture.data = std::vector< uint8_t >();
+	};
+
+	{ //pick up newly loaded assets, and put everything in priority order:
+		std::lock_guard< std::mutex > lock(mutex);
+		for (Handle &asset : loaded) {
+			if (asset->state == State::Failed) {
+				std::cerr << "Failed to stream '" << asset->name << "': " << asset->error << std::endl;
+			} else {
+				uploading.emplace_back(std::move(asset));
+			}
+		}
+		loaded.clear();
+		std::stable_sort(uploading.begin(), uploading.end(), [](Handle const &a, Handle const &b) {
+			return a->priority > b->priority;
+		});
+	}
+	if (uploading.empty()) return;
+
+	//this frame's budget: (the byte budget also has to leave room in the staging ring for the other workspaces' frames,
+	// plus some slack for alignment, skipping past the end of the ring, and other users of Helpers::stream_to_*)
+	VkDeviceSize const ring_share = rtg.configuration.staging_ring_size / (rtg.workspaces.size() + 1);
+	VkDeviceSize const byte_budget = std::min(rtg.configuration.stream_budget, ring_share);
+	uint32_t const copy_budget = rtg.configuration.stream_copies;
+
+	//plan the copies first, so all the layout transitions can go in one barrier before them:
+	struct Copy {
+		Asset *asset;
+		size_t offset; //into the asset's data
+		size_t size;
+		uint32_t level; //(for images)
+	};
+	std::vector< Copy > copies;
+	VkDeviceSize bytes = 0;
+
+	std::vector< VkImageMemoryBarrier > before; //new images: UNDEFINED -> TRANSFER_DST_OPTIMAL
+	std::vector< VkImageMemoryBarrier > after; //finished images: TRANSFER_DST_OPTIMAL -> SHADER_READ_ONLY_OPTIMAL
+	std::vector< Helpers::AllocatedImage * > mipmaps; //finished images whose levels 1+ are generated
+	bool buffers_written = false;
+	std::vector< Asset * > finished;
+
+	auto image_barrier = [](Helpers::AllocatedImage const &image, VkAccessFlags src_access, VkAccessFlags dst_access, VkImageLayout old_layout, VkImageLayout new_layout) {
+		return VkImageMemoryBarrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = src_access,
+			.dstAccessMask = dst_access,
+			.oldLayout = old_layout,
+			.newLayout = new_layout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = image.handle,
+			.subresourceRange{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = image.mip_levels,
+				.baseArrayLayer = 0,
+				.layerCount = image.array_layers,
+			},
+		};
+	};
+
+	for (Handle const &handle : uploading) {
+		if (copies.size() >= copy_budget || bytes >= byte_budget) break;
+		Asset &asset = *handle;
+
+		//first time through, make the resource:
+		if (asset.state == State::Loaded) {
+			try {
+				if (asset.is_texture) {
+					KTX2 const &texture = asset.texture;
+					uint32_t levels = texture.image_mip_levels();
+					if (texture.generate_mips) {
+						//generate_mipmaps needs linear blits; check here rather than have it throw mid-frame:
+						VkFormatProperties properties;
+						vkGetPhysicalDeviceFormatProperties(rtg.physical_device, texture.format, &properties);
+						VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+						if ((properties.optimalTilingFeatures & needed) != needed) {
+							throw std::runtime_error(std::string("mip levels need generating, but format ") + string_VkFormat(texture.format) + " doesn't support linear blits.");
+						}
+					}
+					asset.image = rtg.helpers.create_image(
+						texture.extent,
+						texture.format,
+						VK_IMAGE_TILING_OPTIMAL,
+						VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						Helpers::Unmapped,
+						Helpers::NotBindless,
+						levels,
+						texture.array_layers
+					);
+					//each level is one copy, so each level has to fit in one frame's share of the staging ring:
+					for (uint32_t level = 0; level < (texture.generate_mips ? 1 : levels); ++level) {
+						if (Helpers::mip_level_bytes(asset.image, level) > ring_share) {
+							throw std::runtime_error("mip level " + std::to_string(level) + " is bigger than a frame's share of the staging ring (" + std::to_string(ring_share) + " bytes); increase RTG::Configuration::staging_ring_size.");
+						}
+					}
+					before.emplace_back(image_barrier(asset.image, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+				} else {
+					asset.buffer = rtg.helpers.create_buffer(asset.data.size(), asset.usage, Helpers::GpuOnly);
+				}
+			} catch (std::runtime_error &e) {
+				//(e.g., over RTG::Configuration::memory_limit)
+				fail(asset, e.what());
+				continue;
+			}
+			asset.uploaded = 0;
+			asset.state = State::Uploading;
+		}
+
+		if (asset.is_texture) {
+			//one copy per level, in the order they are packed in data (largest first):
+			uint32_t levels = (asset.texture.generate_mips ? 1 : asset.image.mip_levels);
+			size_t offset = 0;
+			for (uint32_t level = 0; level < asset.uploaded; ++level) offset += Helpers::mip_level_bytes(asset.image, level);
+			while (asset.uploaded < levels && copies.size() < copy_budget) {
+				size_t size = Helpers::mip_level_bytes(asset.image, uint32_t(asset.uploaded));
+				//(a level bigger than the budget still goes, as the only thing this frame)
+				if (bytes + size > byte_budget && bytes != 0) break;
+				copies.emplace_back(Copy{ .asset = &asset, .offset = offset, .size = size, .level = uint32_t(asset.uploaded) });
+				bytes += size;
+				offset += size;
+				asset.uploaded += 1;
+			}
+			if (asset.uploaded == levels) {
+				after.emplace_back(image_barrier(asset.image, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+				if (asset.texture.generate_mips && asset.image.mip_levels > 1) mipmaps.emplace_back(&asset.image);
+				finished.emplace_back(&asset);
+			}
+		} else {
+			//buffers are split at whatever byte budget is left:
+			size_t size = std::min< size_t >(asset.data.size() - asset.uploaded, byte_budget - bytes);
+			copies.emplace_back(Copy{ .asset = &asset, .offset = asset.uploaded, .size = size, .level = 0 });
+			bytes += size;
+			asset.uploaded += size;
+			buffers_written = true;
+			if (asset.uploaded == asset.data.size()) finished.emplace_back(&asset);
+		}
+	}
+
+	//record:
+	if (!before.empty()) {
+		vkCmdPipelineBarrier(command_buffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			uint32_t(before.size()), before.data()
+		);
+	}
+
+	for (Copy const &copy : copies) {
+		if (copy.asset->is_texture) {
+			rtg.helpers.stream_to_image(command_buffer, copy.asset->texture.data.data() + copy.offset, copy.size, copy.asset->image, copy.level);
+		} else {
+			rtg.helpers.stream_to_buffer(command_buffer, copy.asset->data.data() + copy.offset, copy.size, copy.asset->buffer, copy.offset);
+		}
+	}
+
+	//make everything copied this frame visible to whatever reads it later in the frame (or in later frames):
+	// (buffers can be used in so many ways that a global memory barrier is simplest)
+	if (buffers_written || !after.empty()) {
+		VkMemoryBarrier memory_barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+		};
+		vkCmdPipelineBarrier(command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+			(buffers_written ? 1 : 0), &memory_barrier,
+			0, nullptr,
+			uint32_t(after.size()), after.data()
+		);
+	}
+
+	if (!mipmaps.empty()) {
+		rtg.helpers.generate_mipmaps(command_buffer, mipmaps);
+	}
+
+	//finished assets are usable once this frame is done:
+	for (Asset *asset : finished) {
+		asset->ready_frame = rtg.current_frame;
+		asset->state = State::Uploaded;
+		//(the CPU copy isn't needed any more)
+		asset->data = std::vector< uint8_t >();
+		asset->texture.data = std::vector< uint8_t >();
+	}
+	uploading.erase(std::remove_if(uploading.begin(), uploading.end(), [](Handle const &asset) {
+		return asset->state == State::Uploaded || asset->state == State::Failed;
+	}), uploading.end());
+}
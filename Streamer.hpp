@@ -0,0 +1,105 @@
+#pragma once
+
+//Background asset streaming: assets are read (and decoded) on worker threads, then uploaded a little each frame.
+//
+//  Streamer streamer(rtg); //usually a member of the application
+//  Streamer::Handle rock = streamer.stream_texture("rock.ktx2", 1.0f); //returns immediately
+//  streamer.set_priority(rock, screen_area); //higher priorities load and upload first; update as often as you like
+//  ...in render, after vkBeginCommandBuffer:
+//  streamer.update(workspace.command_buffer); //records this frame's share of uploads
+//  if (streamer.ready(rock)) { ...use rock->image... } //ready once the frame that finished its upload is done on the GPU
+//
+// Uploads go through Helpers::stream_to_* (the staging ring), so nothing ever waits on the GPU. Each frame uploads at most
+// RTG::Configuration::stream_budget bytes in at most stream_copies copy commands; big buffers are split across frames,
+// and images go one mip level (all layers) per copy.
+
+#include "Helpers.hpp"
+#include "KTX2.hpp"
+#include "WorkerPool.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct RTG;
+
+//stream_* requests, set_priority, release, and update are all to be called from the main thread.
+struct Streamer {
+	Streamer(RTG &rtg, uint32_t threads = 2); //starts that many loading threads (at least one)
+	Streamer(Streamer const &) = delete; //you shouldn't be copying a Streamer
+	~Streamer(); //drops loads that haven't started, waits for running ones, and destroys all assets' resources (so the GPU must be idle)
+
+	enum class State : uint32_t {
+		Queued, //waiting for a loading thread
+		Loading, //being read/decoded on a loading thread
+		Loaded, //waiting for upload budget
+		Uploading, //resources exist; some copies recorded
+		Uploaded, //every copy recorded; usable once rtg.completed_frame() reaches ready_frame (see ready())
+		Failed, //error says why
+		Released, //given back with release()
+	};
+
+	struct Asset {
+		std::string name; //file name (or whatever the request said), for messages
+		std::atomic< State > state{State::Queued};
+		std::string error; //set before state becomes Failed
+
+		//results: (only one of these is used, depending on the request)
+		Helpers::AllocatedBuffer buffer;
+		Helpers::AllocatedImage image; //VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once uploaded
+		uint64_t ready_frame = 0; //frame whose commands finish the upload
+
+		//internals:
+		float priority = 0.0f; //guarded by Streamer::mutex
+		std::function< void(Asset &) > load; //run on a loading thread; fills data or texture
+		VkBufferUsageFlags usage = 0; //for buffers
+		bool is_texture = false;
+		std::vector< uint8_t > data; //buffer contents, once loaded
+		KTX2 texture; //texture contents, once loaded
+		size_t uploaded = 0; //buffers: bytes copied so far; textures: mip levels copied so far
+	};
+	using Handle = std::shared_ptr< Asset >;
+
+	//request a buffer filled with whatever load returns (load runs on a loading thread; exceptions it throws fail the asset):
+	// (usage gets VK_BUFFER_USAGE_TRANSFER_DST_BIT added; the buffer is device-local)
+	Handle stream_buffer(std::string const &name, std::function< std::vector< uint8_t >() > const &load, VkBufferUsageFlags usage, float priority = 0.0f);
+	//request a buffer filled with a file's contents:
+	Handle stream_file(std::string const &filename, VkBufferUsageFlags usage, float priority = 0.0f);
+	//request a sampled image from a .ktx2 file: (BCn data the device can't sample is decoded on the loading thread)
+	Handle stream_texture(std::string const &filename, float priority = 0.0f);
+
+	//change the order in which waiting assets are loaded and uploaded: (higher first)
+	void set_priority(Handle const &asset, float priority);
+
+	//is the asset's upload complete on the GPU?
+	// (commands recorded after the update() that finished it, in the same frame, may use it already -- check state == Uploaded)
+	bool ready(Handle const &asset) const;
+
+	//stop streaming the asset, and destroy its resources once frames in flight are done with them:
+	void release(Handle const &asset);
+
+	//record uploads for this frame into command_buffer (which must be submitted for rtg.current_frame):
+	// also records the barriers that make the uploaded data readable by any later command in the frame.
+	void update(VkCommandBuffer command_buffer);
+
+	//for progress displays:
+	uint32_t waiting() const; //assets queued, loading, loaded, or uploading
+
+	//internals:
+	RTG &rtg;
+	WorkerPool loaders;
+
+	mutable std::mutex mutex; //guards queued, loaded, and every Asset::priority
+	std::vector< Handle > queued; //waiting for a loading thread (each has one job in loaders)
+	std::vector< Handle > loaded; //loaded (or failed), waiting for update() to pick them up
+	bool quit = false; //set by destructor; loading jobs that haven't started do nothing
+
+	std::vector< Handle > assets; //(main thread) every asset not yet released, so the destructor can free them
+	std::vector< Handle > uploading; //(main thread) Loaded or Uploading assets
+
+	void load_next(); //(run on loading threads) load the highest-priority queued asset
+	Handle enqueue(Handle asset); //add to queued and start a loading job
+};
@@ -3,18 +3,121 @@
 #include "VK.hpp"
 #include "refsol.hpp"
 
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
 #include <cstring>
 #include <iostream>
 
-Tutorial::Tutorial(RTG &rtg_) : rtg(rtg_) {
-	refsol::Tutorial_constructor(rtg, &depth_format, &render_pass, &command_pool);
+Tutorial::Tutorial(RTG &rtg_) : rtg(rtg_), streamer(rtg_) {
+	//select a depth format:
+	// (at least one of these two must be supported, according to the spec; but neither are required)
+	depth_format = rtg.helpers.find_image_format(
+		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32 },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+	);
+
+	if (!rtg.configuration.dynamic_rendering) { //create render pass
+		//attachments:
+		std::array< VkAttachmentDescription, 2 > attachments{
+			VkAttachmentDescription{ //0 - color attachment:
+				.format = rtg.surface_format.format,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			},
+			VkAttachmentDescription{ //1 - depth attachment:
+				.format = depth_format,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			},
+		};
+
+		//subpass:
+		VkAttachmentReference color_attachment_ref{
+			.attachment = 0,
+			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		};
+		VkAttachmentReference depth_attachment_ref{
+			.attachment = 1,
+			.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		};
+		VkSubpassDescription subpass{
+			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			.inputAttachmentCount = 0,
+			.pInputAttachments = nullptr,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &color_attachment_ref,
+			.pDepthStencilAttachment = &depth_attachment_ref,
+		};
+
+		//dependencies:
+		// this defers the image load actions for the attachments:
+		std::array< VkSubpassDependency, 2 > dependencies{
+			VkSubpassDependency{ //color: wait for the swapchain image to be acquired
+				.srcSubpass = VK_SUBPASS_EXTERNAL,
+				.dstSubpass = 0,
+				.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				.srcAccessMask = 0,
+				.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			},
+			VkSubpassDependency{ //depth: wait for the previous frame's depth writes
+				.srcSubpass = VK_SUBPASS_EXTERNAL,
+				.dstSubpass = 0,
+				.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			},
+		};
+
+		VkRenderPassCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+			.attachmentCount = uint32_t(attachments.size()),
+			.pAttachments = attachments.data(),
+			.subpassCount = 1,
+			.pSubpasses = &subpass,
+			.dependencyCount = uint32_t(dependencies.size()),
+			.pDependencies = dependencies.data(),
+		};
+
+		VK( vkCreateRenderPass(rtg.device, &create_info, nullptr, &render_pass) );
+	}
+
+	{ //create command pool
+		VkCommandPoolCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+			.queueFamilyIndex = rtg.graphics_queue_family.value(),
+		};
+		VK( vkCreateCommandPool(rtg.device, &create_info, nullptr, &command_pool) );
+	}
 
 	workspaces.resize(rtg.workspaces.size());
 	for (Workspace &workspace : workspaces) {
 		refsol::Tutorial_constructor_workspace(rtg, command_pool, &workspace.command_buffer);
+
+		workspace.descriptors = rtg.helpers.create_descriptor_allocator({
+			VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 256 },
+			VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 256 },
+			VkDescriptorPoolSize{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 256 },
+		}, 256);
+
+		workspace.frame_data = rtg.helpers.create_frame_arena(1024 * 1024);
 	}
 }
 
@@ -31,19 +134,108 @@ Tutorial::~Tutorial() {
 
 	for (Workspace &workspace : workspaces) {
 		refsol::Tutorial_destructor_workspace(rtg, command_pool, &workspace.command_buffer);
+
+		rtg.helpers.destroy_descriptor_allocator(std::move(workspace.descriptors));
+		rtg.helpers.destroy_frame_arena(std::move(workspace.frame_data));
 	}
 	workspaces.clear();
 
-	refsol::Tutorial_destructor(rtg, &render_pass, &command_pool);
+	if (command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(rtg.device, command_pool, nullptr);
+		command_pool = VK_NULL_HANDLE;
+	}
+
+	if (render_pass != VK_NULL_HANDLE) {
+		vkDestroyRenderPass(rtg.device, render_pass, nullptr);
+		render_pass = VK_NULL_HANDLE;
+	}
 }
 
 void Tutorial::on_swapchain(RTG &rtg_, RTG::SwapchainEvent const &swapchain) {
-	//[re]create framebuffers:
-	refsol::Tutorial_on_swapchain(rtg, swapchain, depth_format, render_pass, &swapchain_depth_image, &swapchain_depth_image_view, &swapchain_framebuffers);
+	//frames still in flight may be using the current framebuffers, so destroy them later:
+	if (!swapchain_framebuffers.empty()) {
+		rtg.helpers.destroy_later([device=rtg.device, framebuffers=swapchain_framebuffers]() {
+			for (VkFramebuffer framebuffer : framebuffers) {
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+			}
+		});
+		swapchain_framebuffers.clear();
+	}
+
+	//[re]create the depth image, unless the new swapchain fits inside the current one:
+	if (swapchain_depth_image.handle == VK_NULL_HANDLE
+	 || swapchain.extent.width > swapchain_depth_image.extent.width
+	 || swapchain.extent.height > swapchain_depth_image.extent.height) {
+		if (swapchain_depth_image.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_later([device=rtg.device, view=swapchain_depth_image_view]() {
+				vkDestroyImageView(device, view, nullptr);
+			});
+			swapchain_depth_image_view = VK_NULL_HANDLE;
+			rtg.helpers.destroy_image_later(std::move(swapchain_depth_image));
+		}
+
+		swapchain_depth_image = rtg.helpers.create_image(
+			swapchain.extent,
+			depth_format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+
+		VkImageViewCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = swapchain_depth_image.handle,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = depth_format,
+			.subresourceRange{
+				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+		};
+		VK( vkCreateImageView(rtg.device, &create_info, nullptr, &swapchain_depth_image_view) );
+	}
+
+	//dynamic rendering draws straight to the image views:
+	if (render_pass == VK_NULL_HANDLE) return;
+
+	//make framebuffers for each swapchain image:
+	// (the depth image may be larger than the swapchain, which is fine for a framebuffer attachment)
+	swapchain_framebuffers.assign(swapchain.image_views.size(), VK_NULL_HANDLE);
+	for (size_t i = 0; i < swapchain.image_views.size(); ++i) {
+		std::array< VkImageView, 2 > attachments{
+			swapchain.image_views[i],
+			swapchain_depth_image_view,
+		};
+		VkFramebufferCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			.renderPass = render_pass,
+			.attachmentCount = uint32_t(attachments.size()),
+			.pAttachments = attachments.data(),
+			.width = swapchain.extent.width,
+			.height = swapchain.extent.height,
+			.layers = 1,
+		};
+		VK( vkCreateFramebuffer(rtg.device, &create_info, nullptr, &swapchain_framebuffers[i]) );
+	}
 }
 
 void Tutorial::destroy_framebuffers() {
-	refsol::Tutorial_destroy_framebuffers(rtg, &swapchain_depth_image, &swapchain_depth_image_view, &swapchain_framebuffers);
+	for (VkFramebuffer &framebuffer : swapchain_framebuffers) {
+		assert(framebuffer != VK_NULL_HANDLE);
+		vkDestroyFramebuffer(rtg.device, framebuffer, nullptr);
+		framebuffer = VK_NULL_HANDLE;
+	}
+	swapchain_framebuffers.clear();
+
+	assert(swapchain_depth_image_view != VK_NULL_HANDLE);
+	vkDestroyImageView(rtg.device, swapchain_depth_image_view, nullptr);
+	swapchain_depth_image_view = VK_NULL_HANDLE;
+
+	rtg.helpers.destroy_image(std::move(swapchain_depth_image));
 }
 
 
@@ -51,17 +243,276 @@ void Tutorial::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 	//assert that parameters are valid:
 	assert(&rtg == &rtg_);
 	assert(render_params.workspace_index < workspaces.size());
-	assert(render_params.image_index < swapchain_framebuffers.size());
+	assert(render_params.image_index < rtg.swapchain_image_views.size());
 
-	//get more convenient names for the current workspace and target framebuffer:
+	//get a more convenient name for the current workspace:
 	Workspace &workspace = workspaces[render_params.workspace_index];
-	VkFramebuffer framebuffer = swapchain_framebuffers[render_params.image_index];
 
-	//record (into `workspace.command_buffer`) commands that run a `render_pass` that just clears `framebuffer`:
-	refsol::Tutorial_render_record_blank_frame(rtg, render_pass, framebuffer, &workspace.command_buffer);
+	//reset the command buffer (clear old commands):
+	VK( vkResetCommandBuffer(workspace.command_buffer, 0) );
 
-	//submit `workspace.command buffer` for the GPU to run:
-	refsol::Tutorial_render_submit(rtg, render_params, workspace.command_buffer);
+	//the workspace's previous frame is done, so its descriptor sets and frame data can all go at once:
+	rtg.helpers.reset_descriptor_allocator(workspace.descriptors);
+	rtg.helpers.reset_frame_arena(workspace.frame_data);
+	{ //begin recording:
+		VkCommandBufferBeginInfo begin_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, //will record again every submit
+		};
+		VK( vkBeginCommandBuffer(workspace.command_buffer, &begin_info) );
+	}
+
+	//this frame's share of background uploads: (before the render pass, since copies can't go inside one)
+	streamer.update(workspace.command_buffer);
+
+	{ //render pass
+		//measure how long the pass takes on the GPU: (see RTG::report_gpu_timings)
+		RTG::GPUTimer timer(rtg, render_params.workspace_index, workspace.command_buffer, "render pass");
+
+		std::array< VkClearValue, 2 > clear_values{
+			VkClearValue{ .color{ .float32{1.0f, 0.73f, 0.0f, 1.0f} } },
+			VkClearValue{ .depthStencil{ .depth = 1.0f, .stencil = 0 } },
+		};
+
+		//draws are recorded into secondary command buffers, which need to know what they will be drawing into:
+		VkCommandBufferInheritanceInfo inheritance{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		};
+		VkCommandBufferInheritanceRenderingInfo inheritance_rendering{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+			.colorAttachmentCount = 1,
+			.pColorAttachmentFormats = &rtg.surface_format.format,
+			.depthAttachmentFormat = depth_format,
+			.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+		};
+
+		if (render_pass != VK_NULL_HANDLE) {
+			VkFramebuffer framebuffer = swapchain_framebuffers[render_params.image_index];
+
+			VkRenderPassBeginInfo begin_info{
+				.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+				.renderPass = render_pass,
+				.framebuffer = framebuffer,
+				.renderArea{
+					.offset = {.x = 0, .y = 0},
+					.extent = rtg.swapchain_extent,
+				},
+				.clearValueCount = uint32_t(clear_values.size()),
+				.pClearValues = clear_values.data(),
+			};
+
+			vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+			inheritance.renderPass = render_pass;
+			inheritance.subpass = 0;
+			inheritance.framebuffer = framebuffer;
+		} else {
+			//with dynamic rendering, layout transitions that the render pass did are done by hand:
+			// (the color image waits on image_available at COLOR_ATTACHMENT_OUTPUT; depth waits on the previous frame's depth writes)
+			std::array< VkImageMemoryBarrier, 2 > barriers{
+				VkImageMemoryBarrier{
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+					.srcAccessMask = 0,
+					.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+					.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+					.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+					.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.image = rtg.swapchain_images[render_params.image_index],
+					.subresourceRange{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1,
+					},
+				},
+				VkImageMemoryBarrier{
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+					.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.image = swapchain_depth_image.handle,
+					.subresourceRange{
+						.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+						.baseMipLevel = 0,
+						.levelCount = 1,
+						.baseArrayLayer = 0,
+						.layerCount = 1,
+					},
+				},
+			};
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				uint32_t(barriers.size()), barriers.data()
+			);
+
+			//load/store ops per attachment: (depth is not needed after the frame, so is never written back to memory)
+			VkRenderingAttachmentInfo color_attachment{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.imageView = rtg.swapchain_image_views[render_params.image_index],
+				.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.clearValue = clear_values[0],
+			};
+			VkRenderingAttachmentInfo depth_attachment{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.imageView = swapchain_depth_image_view,
+				.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+				.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.clearValue = clear_values[1],
+			};
+
+			VkRenderingInfo rendering_info{
+				.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+				.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT,
+				.renderArea{
+					.offset = {.x = 0, .y = 0},
+					.extent = rtg.swapchain_extent,
+				},
+				.layerCount = 1,
+				.colorAttachmentCount = 1,
+				.pColorAttachments = &color_attachment,
+				.pDepthAttachment = &depth_attachment,
+			};
+
+			vkCmdBeginRendering(workspace.command_buffer, &rendering_info);
+
+			inheritance.pNext = &inheritance_rendering;
+		}
+
+		//record draws into secondary command buffers, split across threads:
+		// (there are no pipelines yet, so each "draw" clears one tile of a checkerboard over the background)
+		constexpr uint32_t TileSize = 32;
+		uint32_t tiles_wide = (rtg.swapchain_extent.width + TileSize - 1) / TileSize;
+		uint32_t tiles_high = (rtg.swapchain_extent.height + TileSize - 1) / TileSize;
+		std::vector< VkCommandBuffer > secondaries = rtg.record_parallel(render_params.workspace_index, inheritance, tiles_wide * tiles_high,
+			[&](VkCommandBuffer command_buffer, uint32_t begin, uint32_t end) {
+				//NOTE: runs on worker threads -- only read shared state here.
+				for (uint32_t tile = begin; tile < end; ++tile) {
+					uint32_t x = (tile % tiles_wide) * TileSize;
+					uint32_t y = (tile / tiles_wide) * TileSize;
+
+					VkClearAttachment attachment{
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.colorAttachment = 0,
+						.clearValue = clear_values[0],
+					};
+					if ((tile % tiles_wide + tile / tiles_wide) % 2 == 1) { //darken every other tile:
+						for (uint32_t c = 0; c < 3; ++c) attachment.clearValue.color.float32[c] *= 0.9f;
+					}
+					VkClearRect rect{
+						.rect{
+							.offset{ .x = int32_t(x), .y = int32_t(y) },
+							.extent{
+								.width = std::min(TileSize, rtg.swapchain_extent.width - x),
+								.height = std::min(TileSize, rtg.swapchain_extent.height - y),
+							},
+						},
+						.baseArrayLayer = 0,
+						.layerCount = 1,
+					};
+					vkCmdClearAttachments(command_buffer, 1, &attachment, 1, &rect);
+				}
+			}
+		);
+
+		if (!secondaries.empty()) {
+			vkCmdExecuteCommands(workspace.command_buffer, uint32_t(secondaries.size()), secondaries.data());
+		}
+
+		if (render_pass != VK_NULL_HANDLE) {
+			vkCmdEndRenderPass(workspace.command_buffer);
+		} else {
+			vkCmdEndRendering(workspace.command_buffer);
+
+			//transition the image for presentation, as the render pass's finalLayout would have:
+			VkImageMemoryBarrier to_present{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = 0,
+				.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = rtg.swapchain_images[render_params.image_index],
+				.subresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1,
+				},
+			};
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				1, &to_present
+			);
+		}
+	}
+
+	//end recording:
+	VK( vkEndCommandBuffer(workspace.command_buffer) );
+
+	{ //submit `workspace.command buffer` for the GPU to run:
+		//wait for the image to be available (and for this frame's compute work, if any):
+		std::array< VkSemaphore, 2 > wait_semaphores{
+			render_params.image_available,
+			render_params.compute_done,
+		};
+		std::array< uint64_t, 2 > wait_values{
+			0, //(binary semaphore; value is ignored)
+			render_params.frame,
+		};
+		std::array< VkPipelineStageFlags, 2 > wait_stages{
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		};
+		uint32_t wait_count = (render_params.compute_done != VK_NULL_HANDLE ? 2 : 1);
+
+		//signal that the image is ready to present and that the frame is done:
+		std::array< VkSemaphore, 2 > signal_semaphores{
+			render_params.image_done,
+			render_params.frame_done,
+		};
+		std::array< uint64_t, 2 > signal_values{
+			0, //(binary semaphore; value is ignored)
+			render_params.frame,
+		};
+
+		VkTimelineSemaphoreSubmitInfo timeline_info{
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+			.waitSemaphoreValueCount = wait_count,
+			.pWaitSemaphoreValues = wait_values.data(),
+			.signalSemaphoreValueCount = uint32_t(signal_values.size()),
+			.pSignalSemaphoreValues = signal_values.data(),
+		};
+
+		VkSubmitInfo submit_info{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = &timeline_info,
+			.waitSemaphoreCount = wait_count,
+			.pWaitSemaphores = wait_semaphores.data(),
+			.pWaitDstStageMask = wait_stages.data(),
+			.commandBufferCount = 1,
+			.pCommandBuffers = &workspace.command_buffer,
+			.signalSemaphoreCount = uint32_t(signal_semaphores.size()),
+			.pSignalSemaphores = signal_semaphores.data(),
+		};
+
+		VK( vkQueueSubmit(rtg.graphics_queue, 1, &submit_info, VK_NULL_HANDLE) );
+	}
 }
 
 
@@ -69,5 +520,9 @@ void Tutorial::update(float dt) {
 }
 
 
-void Tutorial::on_input(InputEvent const &) {
+void Tutorial::on_input(InputEvent const &event) {
+	//'T' prints a GPU timing summary:
+	if (event.type == InputEvent::KeyDown && event.key.key == GLFW_KEY_T) {
+		rtg.report_gpu_timings(std::cout);
+	}
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "RTG.hpp"
+#include "Streamer.hpp"
 
 struct Tutorial : RTG::Application {
 
@@ -17,6 +18,7 @@ struct Tutorial : RTG::Application {
 	//chosen format for depth buffer:
 	VkFormat depth_format{};
 	//Render passes describe how pipelines write to images:
+	// (null when rtg.configuration.dynamic_rendering is set -- then render uses vkCmdBeginRendering, and there are no framebuffers)
 	VkRenderPass render_pass = VK_NULL_HANDLE;
 
 	//Pipelines:
@@ -29,21 +31,30 @@ struct Tutorial : RTG::Application {
 	struct Workspace {
 		VkCommandBuffer command_buffer = VK_NULL_HANDLE; //from the command pool above; reset at the start of every render.
 
+		//per-frame descriptor sets come from here; reset at the start of every render:
+		Helpers::DescriptorAllocator descriptors;
+
+		//per-frame uniform/instance data goes here; reset at the start of every render:
+		Helpers::FrameArena frame_data;
 	};
 	std::vector< Workspace > workspaces;
 
 	//-------------------------------------------------------------------
 	//static scene resources:
 
+	//assets are requested from the constructor, but load in the background and upload a little each frame (see Streamer.hpp):
+	// (so the first frame doesn't wait on them; check streamer.ready(handle) before using one)
+	Streamer streamer;
+
 	//--------------------------------------------------------------------
 	//Resources that change when the swapchain is resized:
 
 	virtual void on_swapchain(RTG &, RTG::SwapchainEvent const &) override;
 
-	Helpers::AllocatedImage swapchain_depth_image;
+	Helpers::AllocatedImage swapchain_depth_image; //reused by on_swapchain if the new swapchain fits inside it
 	VkImageView swapchain_depth_image_view = VK_NULL_HANDLE;
-	std::vector< VkFramebuffer > swapchain_framebuffers;
-	//used from on_swapchain and the destructor: (framebuffers are created in on_swapchain)
+	std::vector< VkFramebuffer > swapchain_framebuffers; //(empty when using dynamic rendering)
+	//used from the destructor: (framebuffers are created in on_swapchain; old ones go to Helpers::destroy_later)
 	void destroy_framebuffers();
 
 	//--------------------------------------------------------------------
@@ -0,0 +1,59 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+WorkerPool::WorkerPool(uint32_t thread_count) {
+	thread_count = std::max(1u, thread_count);
+	threads.reserve(thread_count);
+	for (uint32_t t = 0; t < thread_count; ++t) {
+		threads.emplace_back([this](){
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				jobs_cv.wait(lock, [this](){ return quit || !jobs.empty(); });
+				if (jobs.empty()) break; //only get here when quitting with nothing left to do
+
+				std::function< void() > job = std::move(jobs.front());
+				jobs.pop_front();
+				running += 1;
+
+				lock.unlock();
+				try {
+					job();
+				} catch (std::exception &e) {
+					std::cerr << "WorkerPool job threw: " << e.what() << std::endl;
+				}
+				lock.lock();
+
+				running -= 1;
+				idle_cv.notify_all();
+			}
+		});
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	jobs_cv.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+}
+
+void WorkerPool::run(std::function< void() > const &job) {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		jobs.emplace_back(job);
+	}
+	jobs_cv.notify_one();
+}
+
+void WorkerPool::wait_idle() {
+	std::unique_lock< std::mutex > lock(mutex);
+	idle_cv.wait(lock, [this](){ return jobs.empty() && running == 0; });
+}
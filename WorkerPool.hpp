@@ -0,0 +1,38 @@
+#pragma once
+
+//A small pool of worker threads that run queued jobs in first-in-first-out order.
+//
+//  WorkerPool pool(4);
+//  pool.run([](){ slow_thing(); }); //returns immediately; job runs on some worker thread
+//  pool.wait_idle(); //blocks until all queued jobs are finished
+//
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct WorkerPool {
+	WorkerPool(uint32_t thread_count); //starts thread_count worker threads (at least one)
+	WorkerPool(WorkerPool const &) = delete; //you shouldn't be copying a WorkerPool
+	~WorkerPool(); //finishes all queued jobs, then stops the worker threads
+
+	//queue a job to be run on a worker thread:
+	// (exceptions thrown by jobs are reported on std::cerr and otherwise ignored)
+	void run(std::function< void() > const &job);
+
+	//block until the queue is empty and no jobs are running:
+	void wait_idle();
+
+	//internals:
+	std::mutex mutex; //guards everything below
+	std::condition_variable jobs_cv; //notified when jobs are added or when quitting
+	std::condition_variable idle_cv; //notified when a job finishes
+	std::deque< std::function< void() > > jobs;
+	uint32_t running = 0; //number of jobs currently being run
+	bool quit = false;
+	std::vector< std::thread > threads;
+};
@@ -0,0 +1,363 @@
+//convert-scene: turns a Wavefront .obj (and its .mtl files) into a .scene file (see Scene.hpp)
+//
+// usage: convert-scene in.obj out.scene
+//
+// Each o/g/usemtl starts a new mesh; polygons are triangulated as fans; vertices are de-duplicated per mesh;
+// meshes without normals get smoothed face normals.
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+//copy a string into a fixed-size, null-terminated name field, truncating if needed:
+template< size_t N >
+void copy_name(char (&dst)[N], std::string const &src) {
+	std::memset(dst, 0, N);
+	std::memcpy(dst, src.data(), std::min(src.size(), N - 1));
+	if (src.size() > N - 1) {
+		std::cerr << "Warning: truncated '" << src << "' to " << (N - 1) << " characters." << std::endl;
+	}
+}
+
+std::string directory_of(std::string const &path) {
+	size_t slash = path.find_last_of("/\\");
+	if (slash == std::string::npos) return "";
+	return path.substr(0, slash + 1);
+}
+
+//obj "v/vt/vn" references, as zero-based indices (-1 for missing):
+struct Corner {
+	int32_t v = -1, vt = -1, vn = -1;
+	bool operator==(Corner const &) const = default;
+};
+struct CornerHash {
+	size_t operator()(Corner const &c) const {
+		return (size_t(uint32_t(c.v)) * 73856093u) ^ (size_t(uint32_t(c.vt)) * 19349663u) ^ (size_t(uint32_t(c.vn)) * 83492791u);
+	}
+};
+
+struct MeshBuilder {
+	std::string name;
+	std::string material;
+	std::vector< Scene::Position > positions;
+	std::vector< Scene::Attributes > attributes;
+	std::vector< uint32_t > indices;
+	std::unordered_map< Corner, uint32_t, CornerHash > corners;
+	bool missing_normals = false;
+};
+
+void read_mtl(std::string const &filename, std::vector< Scene::Material > *materials, std::unordered_map< std::string, uint32_t > *material_index) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		std::cerr << "Warning: failed to open material library '" << filename << "'; its materials will be missing." << std::endl;
+		return;
+	}
+
+	Scene::Material *current = nullptr;
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream str(line);
+		std::string cmd;
+		if (!(str >> cmd) || cmd[0] == '#') continue;
+		if (cmd == "newmtl") {
+			std::string name;
+			str >> name;
+			material_index->emplace(name, uint32_t(materials->size()));
+			materials->emplace_back();
+			current = &materials->back();
+			std::memset(current, 0, sizeof(*current));
+			copy_name(current->name, name);
+			current->base_color[0] = current->base_color[1] = current->base_color[2] = current->base_color[3] = 1.0f;
+		} else if (current == nullptr) {
+			continue; //(properties before the first newmtl)
+		} else if (cmd == "Kd") {
+			str >> current->base_color[0] >> current->base_color[1] >> current->base_color[2];
+		} else if (cmd == "d") {
+			str >> current->base_color[3];
+		} else if (cmd == "Tr") {
+			float tr = 0.0f;
+			str >> tr;
+			current->base_color[3] = 1.0f - tr;
+		} else if (cmd == "map_Kd") {
+			//the texture path is the last token (earlier ones are options like -bm):
+			std::string token, path;
+			while (str >> token) path = token;
+			copy_name(current->base_color_texture, path);
+		}
+	}
+}
+
+} //namespace
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n    " << argv[0] << " in.obj out.scene" << std::endl;
+		return 1;
+	}
+	std::string in_file = argv[1];
+	std::string out_file = argv[2];
+
+	try {
+		std::ifstream in(in_file, std::ios::binary);
+		if (!in) throw std::runtime_error("Failed to open '" + in_file + "'.");
+
+		std::vector< std::array< float, 3 > > vs;
+		std::vector< std::array< float, 2 > > vts;
+		std::vector< std::array< float, 3 > > vns;
+
+		std::vector< Scene::Material > materials;
+		std::unordered_map< std::string, uint32_t > material_index;
+
+		std::vector< MeshBuilder > meshes;
+		std::string object_name = "mesh";
+		std::string material_name;
+		//start a new mesh the next time a face is read:
+		bool new_mesh = true;
+
+		//obj indices are one-based, or negative to count back from the end:
+		auto resolve = [&](std::string const &token, size_t count, uint32_t line_number) -> int32_t {
+			if (token.empty()) return -1;
+			long index = std::stol(token);
+			if (index < 0) index += long(count);
+			else index -= 1;
+			if (index < 0 || size_t(index) >= count) {
+				throw std::runtime_error("'" + in_file + "' line " + std::to_string(line_number) + " refers to an element that doesn't exist.");
+			}
+			return int32_t(index);
+		};
+
+		std::string line;
+		uint32_t line_number = 0;
+		while (std::getline(in, line)) {
+			line_number += 1;
+			std::istringstream str(line);
+			std::string cmd;
+			if (!(str >> cmd) || cmd[0] == '#') continue;
+			if (cmd == "v") {
+				std::array< float, 3 > &v = vs.emplace_back();
+				str >> v[0] >> v[1] >> v[2];
+			} else if (cmd == "vt") {
+				std::array< float, 2 > &vt = vts.emplace_back();
+				str >> vt[0] >> vt[1];
+			} else if (cmd == "vn") {
+				std::array< float, 3 > &vn = vns.emplace_back();
+				str >> vn[0] >> vn[1] >> vn[2];
+			} else if (cmd == "o" || cmd == "g") {
+				std::string name;
+				std::getline(str >> std::ws, name);
+				if (!name.empty()) object_name = name;
+				new_mesh = true;
+			} else if (cmd == "usemtl") {
+				str >> material_name;
+				new_mesh = true;
+			} else if (cmd == "mtllib") {
+				std::string name;
+				while (str >> name) read_mtl(directory_of(in_file) + name, &materials, &material_index);
+			} else if (cmd == "f") {
+				if (new_mesh) {
+					meshes.emplace_back();
+					meshes.back().name = object_name;
+					meshes.back().material = material_name;
+					new_mesh = false;
+				}
+				MeshBuilder &mesh = meshes.back();
+
+				//look up (or make) the vertex for each corner of the polygon:
+				std::vector< uint32_t > polygon;
+				std::string token;
+				while (str >> token) {
+					std::string parts[3];
+					size_t part = 0;
+					for (char c : token) {
+						if (c == '/') {
+							if (++part == 3) break;
+						} else {
+							parts[part] += c;
+						}
+					}
+					Corner corner{
+						.v = resolve(parts[0], vs.size(), line_number),
+						.vt = resolve(parts[1], vts.size(), line_number),
+						.vn = resolve(parts[2], vns.size(), line_number),
+					};
+					if (corner.v < 0) throw std::runtime_error("'" + in_file + "' line " + std::to_string(line_number) + " has a face corner without a position.");
+
+					auto [it, inserted] = mesh.corners.emplace(corner, uint32_t(mesh.positions.size()));
+					if (inserted) {
+						auto const &v = vs[corner.v];
+						mesh.positions.emplace_back(Scene::Position{ .x = v[0], .y = v[1], .z = v[2] });
+						Scene::Attributes &attribs = mesh.attributes.emplace_back();
+						std::memset(&attribs, 0, sizeof(attribs));
+						if (corner.vn >= 0) {
+							std::copy(vns[corner.vn].begin(), vns[corner.vn].end(), attribs.normal);
+						} else {
+							mesh.missing_normals = true;
+						}
+						if (corner.vt >= 0) {
+							attribs.texcoord[0] = vts[corner.vt][0];
+							attribs.texcoord[1] = 1.0f - vts[corner.vt][1]; //(obj has v pointing up, vulkan has it pointing down)
+						}
+					}
+					polygon.emplace_back(it->second);
+				}
+				if (polygon.size() < 3) throw std::runtime_error("'" + in_file + "' line " + std::to_string(line_number) + " has a face with fewer than three corners.");
+
+				//triangle fan:
+				for (size_t i = 2; i < polygon.size(); ++i) {
+					mesh.indices.emplace_back(polygon[0]);
+					mesh.indices.emplace_back(polygon[i-1]);
+					mesh.indices.emplace_back(polygon[i]);
+				}
+			}
+			//(other commands -- s, l, p, etc -- are ignored)
+		}
+
+		//meshes with missing normals get area-weighted face normals, summed at each vertex:
+		// (only vertices without a normal from the file are touched)
+		for (MeshBuilder &mesh : meshes) {
+			if (!mesh.missing_normals) continue;
+			std::vector< bool > has_normal(mesh.positions.size(), false);
+			for (auto const &[corner, index] : mesh.corners) {
+				has_normal[index] = (corner.vn >= 0);
+			}
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+				Scene::Position const &a = mesh.positions[mesh.indices[i+0]];
+				Scene::Position const &b = mesh.positions[mesh.indices[i+1]];
+				Scene::Position const &c = mesh.positions[mesh.indices[i+2]];
+				float ab[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+				float ac[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+				float n[3] = {
+					ab[1] * ac[2] - ab[2] * ac[1],
+					ab[2] * ac[0] - ab[0] * ac[2],
+					ab[0] * ac[1] - ab[1] * ac[0],
+				};
+				for (size_t k = 0; k < 3; ++k) {
+					uint32_t index = mesh.indices[i+k];
+					if (has_normal[index]) continue;
+					for (size_t d = 0; d < 3; ++d) mesh.attributes[index].normal[d] += n[d];
+				}
+			}
+			for (size_t v = 0; v < mesh.attributes.size(); ++v) {
+				if (has_normal[v]) continue;
+				float *n = mesh.attributes[v].normal;
+				float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length > 0.0f) {
+					n[0] /= length; n[1] /= length; n[2] /= length;
+				} else {
+					n[0] = 0.0f; n[1] = 0.0f; n[2] = 1.0f; //(degenerate; any direction will do)
+				}
+			}
+		}
+
+		//drop meshes that ended up with no faces:
+		meshes.erase(std::remove_if(meshes.begin(), meshes.end(), [](MeshBuilder const &mesh) { return mesh.indices.empty(); }), meshes.end());
+
+		//lay out the file:
+		auto align = [](uint64_t offset) {
+			return (offset + Scene::SectionAlignment - 1) / Scene::SectionAlignment * Scene::SectionAlignment;
+		};
+
+		Scene::Header header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, Scene::Magic, sizeof(Scene::Magic));
+		header.version = Scene::Version;
+		header.mesh_count = uint32_t(meshes.size());
+		header.material_count = uint32_t(materials.size());
+		for (MeshBuilder const &mesh : meshes) {
+			header.vertex_count += mesh.positions.size();
+			header.index_count += mesh.indices.size();
+		}
+		if (header.vertex_count > std::numeric_limits< uint32_t >::max() || header.index_count > std::numeric_limits< uint32_t >::max()) {
+			throw std::runtime_error("'" + in_file + "' has more vertices or indices than a scene's 32-bit mesh ranges can address.");
+		}
+		header.meshes_offset = align(sizeof(Scene::Header));
+		header.materials_offset = align(header.meshes_offset + header.mesh_count * sizeof(Scene::Mesh));
+		header.positions_offset = align(header.materials_offset + header.material_count * sizeof(Scene::Material));
+		header.attributes_offset = align(header.positions_offset + header.vertex_count * sizeof(Scene::Position));
+		header.indices_offset = align(header.attributes_offset + header.vertex_count * sizeof(Scene::Attributes));
+
+		std::vector< Scene::Mesh > mesh_records;
+		mesh_records.reserve(meshes.size());
+		uint32_t first_vertex = 0;
+		uint32_t first_index = 0;
+		for (MeshBuilder const &mesh : meshes) {
+			Scene::Mesh &record = mesh_records.emplace_back();
+			std::memset(&record, 0, sizeof(record));
+			copy_name(record.name, mesh.name);
+			record.first_vertex = first_vertex;
+			record.vertex_count = uint32_t(mesh.positions.size());
+			record.first_index = first_index;
+			record.index_count = uint32_t(mesh.indices.size());
+			record.material = -1U;
+			if (!mesh.material.empty()) {
+				auto f = material_index.find(mesh.material);
+				if (f != material_index.end()) record.material = f->second;
+				else std::cerr << "Warning: mesh '" << mesh.name << "' uses undefined material '" << mesh.material << "'." << std::endl;
+			}
+			for (size_t d = 0; d < 3; ++d) {
+				record.bounds_min[d] = std::numeric_limits< float >::infinity();
+				record.bounds_max[d] = -std::numeric_limits< float >::infinity();
+			}
+			for (Scene::Position const &p : mesh.positions) {
+				float xyz[3] = { p.x, p.y, p.z };
+				for (size_t d = 0; d < 3; ++d) {
+					record.bounds_min[d] = std::min(record.bounds_min[d], xyz[d]);
+					record.bounds_max[d] = std::max(record.bounds_max[d], xyz[d]);
+				}
+			}
+			first_vertex += record.vertex_count;
+			first_index += record.index_count;
+		}
+
+		//write it:
+		std::ofstream out(out_file, std::ios::binary);
+		if (!out) throw std::runtime_error("Failed to open '" + out_file + "' for writing.");
+
+		uint64_t written = 0;
+		auto write = [&](void const *data, size_t size) {
+			out.write(reinterpret_cast< char const * >(data), std::streamsize(size));
+			written += size;
+		};
+		auto pad_to = [&](uint64_t offset) {
+			static char const zeros[Scene::SectionAlignment] = {};
+			assert(offset >= written && offset - written < Scene::SectionAlignment);
+			write(zeros, size_t(offset - written));
+		};
+
+		write(&header, sizeof(header));
+		pad_to(header.meshes_offset);
+		write(mesh_records.data(), mesh_records.size() * sizeof(Scene::Mesh));
+		pad_to(header.materials_offset);
+		write(materials.data(), materials.size() * sizeof(Scene::Material));
+		pad_to(header.positions_offset);
+		for (MeshBuilder const &mesh : meshes) write(mesh.positions.data(), mesh.positions.size() * sizeof(Scene::Position));
+		pad_to(header.attributes_offset);
+		for (MeshBuilder const &mesh : meshes) write(mesh.attributes.data(), mesh.attributes.size() * sizeof(Scene::Attributes));
+		pad_to(header.indices_offset);
+		for (MeshBuilder const &mesh : meshes) write(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+
+		if (!out) throw std::runtime_error("Failed to write '" + out_file + "'.");
+
+		std::cout << "Wrote '" << out_file << "': " << header.mesh_count << " meshes, " << header.material_count << " materials, "
+		          << header.vertex_count << " vertices, " << header.index_count / 3 << " triangles (" << written << " bytes)." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "Failed to convert '" << in_file << "':\n" << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}